@@ -0,0 +1,18 @@
+#!/bin/sh
+# Run the array benchmarks: compile every program with cmilan and time it
+# on the virtual machine.
+#
+# Run from the cmilan directory after make and make -C ../vm mvm:
+#     sh bench/array_bench.sh
+# (another virtual machine may be given in MVM)
+
+MVM=${MVM:-../vm/mvm}
+DIR=${TMPDIR:-/tmp}
+
+for name in sieve sort vector vector_loop; do
+    ./cmilan bench/$name.mil > "$DIR/$name.ms" || exit 1
+    start=$(date +%s%N)
+    result=$("$MVM" --batch-io "$DIR/$name.ms" | tr '\n' ' ')
+    end=$(date +%s%N)
+    echo "$name: $(( (end - start) / 1000000 )) ms, output: $result"
+done
@@ -0,0 +1,99 @@
+// Benchmark of the code output: emits a program of one million instructions
+// and prints it with every output sink and with the plain iostream printing
+// (one "<<" chain and std::endl per instruction) for comparison.
+//
+// Usage: flush_bench [output_file]
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "codegen.h"
+
+static const int s_ProgramSize = 1000000;
+
+static void EmitProgram(CodeGen &codegen) {
+    // A typical loop body: i := i + k; IF i < n THEN ... FI; WHILE ... OD
+    for (int address = 0; address < s_ProgramSize; address += 8) {
+        codegen.emit(LOAD, address % 1000);
+        codegen.emit(PUSH, address);
+        codegen.emit(ADD);
+        codegen.emit(STORE, address % 1000);
+        codegen.emit(LOAD, 1);
+        codegen.emit(COMPARE, 2);
+        codegen.emit(JUMP_NO, address + 8);
+        codegen.emit(JUMP, address);
+    }
+}
+
+static double Measure(const std::function<void()> &action) {
+    auto start = std::chrono::steady_clock::now();
+    action();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+static void Report(const char *name, double seconds) {
+    std::printf("%-24s %8.1f ms  %6.1f M instructions/s\n", name,
+                seconds * 1000, s_ProgramSize / seconds / 1e6);
+}
+
+// The output as it used to be printed before the sinks.
+static void PrintWithIostream(const CodeGen &codegen, std::ostream &os) {
+    static const char *names[] = {
+        "NOP",  "STOP", "LOAD", "STORE",  "BLOAD",   "BSTORE", "PUSH",
+        "POP",  "DUP",  "ADD",  "SUB",    "MULT",    "DIV",    "INVERT",
+        "COMPARE", "JUMP", "JUMP_YES", "JUMP_NO", "INPUT", "PRINT"};
+    for (int address = 0; address < s_ProgramSize; ++address) {
+        const Command &command = codegen.getCommand(address);
+        os << address << ":\t" << names[command.instruction];
+        if (command.instruction == LOAD || command.instruction == STORE ||
+            command.instruction == PUSH || command.instruction == COMPARE ||
+            HasCodeAddress(command.instruction)) {
+            os << "\t" << command.argument;
+        }
+        os << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string path = argc > 1 ? argv[1] : "flush_bench.out";
+
+    {
+        BufferSink unused;
+        CodeGen codegen(unused);
+        EmitProgram(codegen);
+        std::ofstream file(path);
+        Report("iostream + std::endl",
+               Measure([&] { PrintWithIostream(codegen, file); }));
+    }
+
+    {
+        std::ofstream file(path);
+        StreamSink sink(file);
+        CodeGen codegen(sink);
+        EmitProgram(codegen);
+        Report("StreamSink (ofstream)", Measure([&] { codegen.flush(); }));
+    }
+
+    {
+        BufferSink sink;
+        CodeGen codegen(sink);
+        EmitProgram(codegen);
+        Report("BufferSink (memory)", Measure([&] { codegen.flush(); }));
+    }
+
+    {
+        FileSink sink(path);
+        CodeGen codegen(sink);
+        EmitProgram(codegen);
+        Report("FileSink (one write)", Measure([&] { codegen.flush(); }));
+    }
+
+    std::remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Run the input and output benchmarks: compile every program with cmilan
+# and time it on the virtual machine with 200003 numbers on stdin.
+#
+# Run from the cmilan directory after make and make -C ../vm mvm:
+#     sh bench/io_bench.sh
+# (another virtual machine may be given in MVM)
+
+MVM=${MVM:-../vm/mvm}
+DIR=${TMPDIR:-/tmp}
+
+seq 1 200003 > "$DIR/io_bench.in"
+for name in io io_loop; do
+    ./cmilan bench/$name.mil > "$DIR/$name.ms" || exit 1
+    start=$(date +%s%N)
+    result=$("$MVM" --batch-io "$DIR/$name.ms" < "$DIR/io_bench.in" | \
+             tail -n 2 | tr '\n' ' ')
+    end=$(date +%s%N)
+    echo "$name: $(( (end - start) / 1000000 )) ms, output: $result"
+done
+rm -f "$DIR/io_bench.in"
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "output.h"
+#include "version.h"
+
+namespace fs = std::filesystem;
+
+static const char *s_EntryExtension = ".ms";
+
+CompileCache::CompileCache(const std::string &directory,
+                           std::uintmax_t maxSize)
+    : m_Directory(directory), m_MaxSize(maxSize) {
+    std::error_code ec;
+    fs::create_directories(m_Directory, ec);
+
+    std::uintmax_t size = 0;
+    for (fs::directory_iterator it(m_Directory, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->path().extension() == s_EntryExtension) {
+            size += it->file_size(ec);
+        }
+    }
+    m_Size = size;
+}
+
+std::string CompileCache::Key(const std::string &source) {
+    std::uint64_t hash = Fnv1a(CMILAN_VERSION);
+    hash = Fnv1a(std::string(1, '\0'), hash);
+    hash = Fnv1a(source, hash);
+
+    // The length of the source makes an accidental collision even less
+    // likely.
+    return HashToString(hash) + '-' + std::to_string(source.size());
+}
+
+std::string CompileCache::EntryPath(const std::string &key) const {
+    return (fs::path(m_Directory) / (key + s_EntryExtension)).string();
+}
+
+bool CompileCache::Lookup(const std::string &key, std::string &code) {
+    std::string path = EntryPath(key);
+    std::ifstream entry(path, std::ios::binary);
+    if (!entry) {
+        ++m_Misses;
+        return false;
+    }
+
+    std::ostringstream text;
+    text << entry.rdbuf();
+    code = text.str();
+    ++m_Hits;
+
+    // Mark the entry as recently used.
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void CompileCache::Store(const std::string &key, const std::string &code) {
+    std::string path = EntryPath(key);
+
+    // The process and the thread make the name unique when several compilers
+    // share the cache directory.
+    std::ostringstream temporary;
+    temporary << path << ".tmp." << getpid() << '.'
+              << std::this_thread::get_id();
+    std::error_code ec;
+    FileSink entry(temporary.str());
+    entry.write(code.data(), code.size());
+    if (!entry.close()) {
+        fs::remove(temporary.str(), ec);
+        return;
+    }
+
+    fs::rename(temporary.str(), path, ec);
+    if (ec) {
+        fs::remove(temporary.str(), ec);
+        return;
+    }
+
+    ++m_Stores;
+    if ((m_Size += code.size()) > m_MaxSize) {
+        Evict();
+    }
+}
+
+void CompileCache::Evict() {
+    std::lock_guard<std::mutex> lock(m_EvictMutex);
+
+    struct Entry {
+        fs::path path;
+        fs::file_time_type time;
+        std::uintmax_t size;
+    };
+
+    std::vector<Entry> entries;
+    std::uintmax_t size = 0;
+    std::error_code ec;
+    for (fs::directory_iterator it(m_Directory, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->path().extension() != s_EntryExtension) {
+            continue;
+        }
+        std::error_code entryError;
+        Entry entry{it->path(), it->last_write_time(entryError),
+                    it->file_size(entryError)};
+        if (!entryError) {
+            entries.push_back(entry);
+            size += entry.size;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.time < b.time; });
+
+    for (const Entry &entry : entries) {
+        if (size <= m_MaxSize) {
+            break;
+        }
+        if (fs::remove(entry.path, ec)) {
+            size -= entry.size;
+            ++m_Evictions;
+        }
+    }
+
+    m_Size = size;
+}
+
+CompileCache::Stats CompileCache::GetStats() const {
+    Stats stats;
+    stats.hits = m_Hits;
+    stats.misses = m_Misses;
+    stats.stores = m_Stores;
+    stats.evictions = m_Evictions;
+    return stats;
+}
@@ -0,0 +1,68 @@
+#ifndef CMILAN_CACHE_H
+#define CMILAN_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/* Content-addressed compile cache.
+ *
+ * The cache keeps the generated code of the successfully compiled programs
+ * in a directory, one file per entry. The entry name is computed from the
+ * source text and the compiler version, so a changed input or a new compiler
+ * never hits a stale entry. None of the command line options change the
+ * generated code (the line map bypasses the cache), so they are not a part
+ * of the key.
+ *
+ * The total size of the entries is bounded. When the bound is exceeded, the
+ * least recently used entries are removed (a hit updates the modification
+ * time of the entry).
+ *
+ * The cache can be used from several threads and processes at once: entries
+ * are written to a temporary file and renamed into place.
+ * */
+class CompileCache {
+public:
+    struct Stats {
+        unsigned long hits = 0;
+        unsigned long misses = 0;
+        unsigned long stores = 0;
+        unsigned long evictions = 0;
+    };
+
+    // Open (and create if needed) the cache in the directory.
+    CompileCache(const std::string &directory, std::uintmax_t maxSize);
+
+    // Build the key for the source text.
+    static std::string Key(const std::string &source);
+
+    // Find the code stored for the key. Returns false on a miss.
+    bool Lookup(const std::string &key, std::string &code);
+
+    // Store the code for the key and evict old entries if the cache is too
+    // big.
+    void Store(const std::string &key, const std::string &code);
+
+    Stats GetStats() const;
+
+private:
+    std::string EntryPath(const std::string &key) const;
+
+    // Remove the least recently used entries until the cache fits in
+    // m_MaxSize.
+    void Evict();
+
+private:
+    const std::string m_Directory;
+    const std::uintmax_t m_MaxSize;
+    std::mutex m_EvictMutex;
+    // Approximate size of the entries, recalculated by Evict().
+    std::atomic<std::uintmax_t> m_Size{0};
+    std::atomic<unsigned long> m_Hits{0};
+    std::atomic<unsigned long> m_Misses{0};
+    std::atomic<unsigned long> m_Stores{0};
+    std::atomic<unsigned long> m_Evictions{0};
+};
+
+#endif // CMILAN_CACHE_H
@@ -1,128 +1,505 @@
+#include <algorithm>
+#include <cstdint>
+
 #include "codegen.h"
 
+static bool FitsIn32Bits(Word value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Compute j op k for a folded operation. Returns false if the instruction is
+// not an arithmetic operation or the result depends on the word size of the
+// virtual machine; division by zero is left to the run time error.
+static bool Fold(Instruction instruction, Word j, Word k, Word &result) {
+    if (!FitsIn32Bits(j) || !FitsIn32Bits(k)) {
+        return false;
+    }
+    switch (instruction) {
+    case ADD:
+        result = j + k;
+        break;
+    case SUB:
+        result = j - k;
+        break;
+    case MULT:
+        result = j * k;
+        break;
+    case DIV:
+        if (k == 0) {
+            return false;
+        }
+        result = j / k;
+        break;
+    default:
+        return false;
+    }
+    return FitsIn32Bits(result);
+}
+
+bool HasCodeAddress(Instruction instruction) {
+    return instruction == JUMP || instruction == JUMP_YES ||
+           instruction == JUMP_NO || instruction == LOOP;
+}
+
 Command::Command(Instruction instruction) : instruction(instruction) {}
 
-Command::Command(Instruction instruction, int arg)
+Command::Command(Instruction instruction, Word arg)
     : instruction(instruction), argument(arg) {}
 
-void Command::print(int address, std::ostream &os) {
-    os << address << ":\t";
+void Command::print(int address, TextWriter &writer) const {
+    writer.writeNumber(address);
+    writer.write(":\t");
     switch (instruction) {
     case NOP:
-        os << "NOP";
+        writer.write("NOP");
         break;
 
     case STOP:
-        os << "STOP";
+        writer.write("STOP");
         break;
 
     case LOAD:
-        os << "LOAD\t" << argument;
+        writer.write("LOAD\t");
+        writer.writeNumber(argument);
         break;
 
     case STORE:
-        os << "STORE\t" << argument;
+        writer.write("STORE\t");
+        writer.writeNumber(argument);
         break;
 
     case BLOAD:
-        os << "BLOAD\t" << argument;
+        writer.write("BLOAD\t");
+        writer.writeNumber(argument);
         break;
 
     case BSTORE:
-        os << "BSTORE\t" << argument;
+        writer.write("BSTORE\t");
+        writer.writeNumber(argument);
         break;
 
     case PUSH:
-        os << "PUSH\t" << argument;
+        writer.write("PUSH\t");
+        writer.writeNumber(argument);
         break;
 
     case POP:
-        os << "POP";
+        writer.write("POP");
         break;
 
     case DUP:
-        os << "DUP";
+        writer.write("DUP");
         break;
 
     case ADD:
-        os << "ADD";
+        writer.write("ADD");
         break;
 
     case SUB:
-        os << "SUB";
+        writer.write("SUB");
         break;
 
     case MULT:
-        os << "MULT";
+        writer.write("MULT");
         break;
 
     case DIV:
-        os << "DIV";
+        writer.write("DIV");
         break;
 
     case INVERT:
-        os << "INVERT";
+        writer.write("INVERT");
         break;
 
     case COMPARE:
-        os << "COMPARE\t" << argument;
+        writer.write("COMPARE\t");
+        writer.writeNumber(argument);
         break;
 
     case JUMP:
-        os << "JUMP\t" << argument;
+        writer.write("JUMP\t");
+        writer.writeNumber(argument);
         break;
 
     case JUMP_YES:
-        os << "JUMP_YES\t" << argument;
+        writer.write("JUMP_YES\t");
+        writer.writeNumber(argument);
         break;
 
     case JUMP_NO:
-        os << "JUMP_NO\t" << argument;
+        writer.write("JUMP_NO\t");
+        writer.writeNumber(argument);
         break;
 
     case INPUT:
-        os << "INPUT";
+        writer.write("INPUT");
         break;
 
     case PRINT:
-        os << "PRINT";
+        writer.write("PRINT");
+        break;
+
+    case LOOP:
+        writer.write("LOOP\t");
+        writer.writeNumber(argument);
+        break;
+
+    case CALL:
+        writer.write("CALL\t");
+        writer.writeNumber(argument);
+        break;
+
+    case RET:
+        writer.write("RET");
+        break;
+
+    case JUMP_TABLE:
+        writer.write("JUMP_TABLE\t");
+        writer.writeNumber(argument);
+        break;
+
+    case ADDI:
+        writer.write("ADDI\t");
+        writer.writeNumber(argument);
+        break;
+
+    case SUBI:
+        writer.write("SUBI\t");
+        writer.writeNumber(argument);
+        break;
+
+    case MULI:
+        writer.write("MULI\t");
+        writer.writeNumber(argument);
+        break;
+
+    case INC:
+        writer.write("INC\t");
+        writer.writeNumber(argument);
+        break;
+
+    case DEC:
+        writer.write("DEC\t");
+        writer.writeNumber(argument);
+        break;
+
+    case ADDM:
+        writer.write("ADDM\t");
+        writer.writeNumber(argument);
+        break;
+
+    case VADD:
+        writer.write("VADD");
+        break;
+
+    case VMUL:
+        writer.write("VMUL");
+        break;
+
+    case VSUM:
+        writer.write("VSUM");
+        break;
+
+    case VFILL:
+        writer.write("VFILL");
+        break;
+
+    case VCOPY:
+        writer.write("VCOPY");
+        break;
+
+    case PARALLEL:
+        writer.write("PARALLEL\t");
+        writer.writeNumber(argument);
+        break;
+
+    case REDUCE:
+        writer.write("REDUCE\t");
+        writer.writeNumber(argument);
+        break;
+
+    case INPUT_BLOCK:
+        writer.write("INPUT_BLOCK");
+        break;
+
+    case PRINT_BLOCK:
+        writer.write("PRINT_BLOCK");
+        break;
+
+    case PRINT_STACK:
+        writer.write("PRINT_STACK\t");
+        writer.writeNumber(argument);
         break;
     }
 
-    os << std::endl;
+    writer.write('\n');
 }
 
-CodeGen::CodeGen(std::ostream &output) : m_OutputStream(output) {}
+CodeGen::CodeGen(OutputSink &output, CompileStats *stats)
+    : m_Output(output), m_Stats(stats) {}
 
 void CodeGen::emit(Instruction instruction) {
-    m_Commands.push_back(Command(instruction));
+    emit(Command(instruction));
 }
 
-void CodeGen::emit(Instruction instruction, int arg) {
-    m_Commands.push_back(Command(instruction, arg));
+void CodeGen::emit(Instruction instruction, Word arg) {
+    emit(Command(instruction, arg));
+}
+
+void CodeGen::emit(const Command &command) {
+    if (!combine(command)) {
+        append(command);
+    }
+}
+
+void CodeGen::append(const Command &command) {
+    m_Commands.push_back(command);
+    m_Lines.push_back(m_Line);
+    if (m_Stats) {
+        ++m_Stats->instructions;
+    }
+}
+
+bool CodeGen::combine(const Command &command) {
+    int size = m_Commands.size();
+    if (size < 1 || m_Label > size - 1) {
+        return false;
+    }
+
+    const Command &last = m_Commands[size - 1];
+    if (last.instruction == PUSH && size >= 2 && m_Label <= size - 2 &&
+        m_Commands[size - 2].instruction == PUSH) {
+        Word value;
+        if (Fold(command.instruction, m_Commands[size - 2].argument,
+                 last.argument, value)) {
+            replaceTail(size - 2, Command(PUSH, value));
+            return true;
+        }
+    }
+    if (last.instruction == PUSH && command.instruction == INVERT &&
+        last.argument != INT64_MIN) {
+        replaceTail(size - 1, Command(PUSH, -last.argument));
+        return true;
+    }
+    if (last.instruction == PUSH) {
+        switch (command.instruction) {
+        case ADD:
+            replaceTail(size - 1, Command(ADDI, last.argument));
+            return true;
+        case SUB:
+            replaceTail(size - 1, Command(SUBI, last.argument));
+            return true;
+        case MULT:
+            replaceTail(size - 1, Command(MULI, last.argument));
+            return true;
+        default:
+            return false;
+        }
+    }
+    if (last.instruction == LOAD && command.instruction == ADD) {
+        replaceTail(size - 1, Command(ADDM, last.argument));
+        return true;
+    }
+
+    if (command.instruction == STORE && size >= 2 && m_Label <= size - 2) {
+        const Command &load = m_Commands[size - 2];
+        if (load.instruction != LOAD || load.argument != command.argument) {
+            return false;
+        }
+        Word step = last.instruction == ADDI   ? last.argument
+                    : last.instruction == SUBI ? -last.argument
+                                               : 0;
+        if (step == 1 || step == -1) {
+            replaceTail(size - 2, Command(step == 1 ? INC : DEC,
+                                          command.argument));
+            return true;
+        }
+    }
+    return false;
+}
+
+void CodeGen::replaceTail(int address, const Command &command) {
+    int removed = m_Commands.size() - address;
+    m_Commands.erase(m_Commands.begin() + address, m_Commands.end());
+    m_Commands.push_back(command);
+    m_Lines.erase(m_Lines.begin() + address + 1, m_Lines.end());
+    if (m_Stats) {
+        m_Stats->instructions -= removed - 1;
+        m_Stats->combined += removed;
+    }
 }
 
 void CodeGen::emitAt(int address, Instruction instruction) {
-    m_Commands[address] = Command(instruction);
+    emitAt(address, instruction, 0);
 }
 
-void CodeGen::emitAt(int address, Instruction instruction, int arg) {
+void CodeGen::emitAt(int address, Instruction instruction, Word arg) {
     m_Commands[address] = Command(instruction, arg);
+    if (m_Stats) {
+        ++m_Stats->backpatches;
+    }
 }
 
 int CodeGen::getCurrentAddress() {
-    return m_Commands.size();
+    m_Label = m_Commands.size();
+    return m_Label;
+}
+
+const Command &CodeGen::getCommand(int address) const {
+    return m_Commands[address];
+}
+
+void CodeGen::moveBefore(int first, int middle) {
+    int end = getCurrentAddress();
+    for (int address = first; address < end; ++address) {
+        Command &command = m_Commands[address];
+        if (!HasCodeAddress(command.instruction) ||
+            command.argument < first || command.argument >= end) {
+            continue;
+        }
+        if (command.argument <= middle) {
+            command.argument += end - middle;
+        } else {
+            command.argument -= middle - first;
+        }
+    }
+
+    std::rotate(m_Commands.begin() + first, m_Commands.begin() + middle,
+                m_Commands.end());
+    std::rotate(m_Lines.begin() + first, m_Lines.begin() + middle,
+                m_Lines.end());
+}
+
+void CodeGen::cut(int start, std::vector<Command> &commands,
+                  std::vector<int> &lines) {
+    commands.assign(m_Commands.begin() + start, m_Commands.end());
+    lines.assign(m_Lines.begin() + start, m_Lines.end());
+    for (Command &command : commands) {
+        if (HasCodeAddress(command.instruction)) {
+            command.argument -= start;
+        }
+    }
+
+    m_Commands.erase(m_Commands.begin() + start, m_Commands.end());
+    m_Lines.erase(m_Lines.begin() + start, m_Lines.end());
+    if (m_Stats) {
+        m_Stats->instructions -= commands.size();
+    }
+}
+
+void CodeGen::emitCode(const std::vector<Command> &commands,
+                       const std::vector<int> &lines) {
+    int start = getCurrentAddress();
+    int line = m_Line;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        Command command = commands[i];
+        if (HasCodeAddress(command.instruction)) {
+            command.argument += start;
+        }
+        m_Line = lines[i];
+        append(command);
+    }
+    m_Line = line;
+    getCurrentAddress();
 }
 
 int CodeGen::reserve() {
     emit(NOP);
+    if (m_Stats) {
+        ++m_Stats->reserved;
+    }
     return m_Commands.size() - 1;
 }
 
 void CodeGen::flush() {
+    CompileStats::Clock::time_point start;
+    if (m_Stats) {
+        start = CompileStats::Clock::now();
+    }
+
+    TextWriter writer(m_Output);
+    if (m_DataSize > DefaultMemorySize) {
+        writer.write("MEMORY_SIZE\t");
+        writer.writeNumber(m_DataSize);
+        writer.write('\n');
+    }
+    for (const std::pair<int, Word> &word : m_Data) {
+        writer.write("SET\t");
+        writer.writeNumber(word.first);
+        writer.write('\t');
+        writer.writeNumber(word.second);
+        writer.write('\n');
+    }
     int count = m_Commands.size();
     for (int address = 0; address < count; ++address) {
-        m_Commands[address].print(address, m_OutputStream);
+        m_Commands[address].print(address, writer);
+    }
+    writer.flush();
+    m_Output.close();
+
+    if (m_Stats) {
+        m_Stats->outputSeconds += SecondsSince(start);
+        m_Stats->outputBytes += writer.count();
+    }
+}
+
+void CodeGen::setDataSize(int words) {
+    m_DataSize = words;
+}
+
+void CodeGen::moveInitializersToData() {
+    int size = m_Commands.size();
+    int end = 0;
+    while (end + 1 < size && m_Commands[end].instruction == PUSH &&
+           m_Commands[end + 1].instruction == STORE &&
+           m_Commands[end + 1].argument >= 0) {
+        end += 2;
+    }
+
+    // A jump back into the pairs would run the assignments again.
+    for (const Command &command : m_Commands) {
+        if ((HasCodeAddress(command.instruction) ||
+             command.instruction == CALL) &&
+            command.argument < end) {
+            end = command.argument - command.argument % 2;
+        }
+    }
+    if (end == 0) {
+        return;
+    }
+
+    for (int address = 0; address < end; address += 2) {
+        m_Data.emplace_back(m_Commands[address + 1].argument,
+                            m_Commands[address].argument);
+    }
+    m_Commands.erase(m_Commands.begin(), m_Commands.begin() + end);
+    m_Lines.erase(m_Lines.begin(), m_Lines.begin() + end);
+    for (Command &command : m_Commands) {
+        if (HasCodeAddress(command.instruction) ||
+            command.instruction == CALL) {
+            command.argument -= end;
+        }
+    }
+    m_Label = std::max(m_Label - end, 0);
+    if (m_Stats) {
+        m_Stats->instructions -= end;
+        m_Stats->initializers += end / 2;
+    }
+}
+
+void CodeGen::setLine(int line) {
+    m_Line = line;
+}
+
+void CodeGen::printLineMap(OutputSink &output) const {
+    TextWriter writer(output);
+    int count = m_Lines.size();
+    for (int address = 0; address < count; ++address) {
+        writer.writeNumber(address);
+        writer.write('\t');
+        writer.writeNumber(m_Lines[address]);
+        writer.write('\n');
     }
-    m_OutputStream.flush();
+    writer.flush();
+    output.close();
 }
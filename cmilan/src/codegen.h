@@ -1,9 +1,12 @@
 #ifndef CMILAN_CODEGEN_H
 #define CMILAN_CODEGEN_H
 
-#include <iostream>
 #include <vector>
 
+#include "output.h"
+#include "stats.h"
+#include "word.h"
+
 // Milan virtual machine instructions.
 enum Instruction {
     NOP,
@@ -47,51 +50,187 @@ enum Instruction {
     // Read integer from stdin and store on the stack.
     INPUT,
     // Print integer from the stack to stdout
-    PRINT
+    PRINT,
+    // LOOP addr - step of a counted loop. The stack holds the limit, the step
+    // and the address of the counter (on the top). The counter is increased
+    // by the step; if it has not passed the limit, jump to addr, otherwise
+    // remove the three words from the stack.
+    LOOP,
+    // CALL addr - call the procedure at address addr. The return address is
+    // kept on a separate return stack.
+    CALL,
+    // Return to the address taken from the return stack.
+    RET,
+    // JUMP_TABLE n - the instruction is followed by a table of n JUMP
+    // instructions. Remove the value v from the stack; if 0 <= v < n, jump to
+    // the address of the v-th of them, otherwise continue after the table.
+    JUMP_TABLE,
+    // ADDI k, SUBI k, MULI k - add k to, subtract k from or multiply by k
+    // the word on the top of the stack.
+    ADDI,
+    SUBI,
+    MULI,
+    // INC addr, DEC addr - increase or decrease the data word at address addr
+    // by 1.
+    INC,
+    DEC,
+    // ADDM addr - add the data word at address addr to the word on the top
+    // of the stack.
+    ADDM,
+    // Operations on ranges of data words; the arguments are removed from the
+    // stack, the first one is the deepest.
+    // VADD - dst, a, b, n: dst[i] = a[i] + b[i] for i < n.
+    VADD,
+    // VMUL - dst, a, b, n: dst[i] = a[i] * b[i] for i < n.
+    VMUL,
+    // VSUM - a, n: push the sum of a[i] for i < n.
+    VSUM,
+    // VFILL - dst, n, value: dst[i] = value for i < n.
+    VFILL,
+    // VCOPY - dst, src, n: copy n words, the ranges may overlap.
+    VCOPY,
+    // PARALLEL n - run the loop that follows on the threads of the VM with
+    // n private words each. The instruction is followed by the REDUCE table,
+    // JUMP to the exit and the body ending with LOOP. The first value of the
+    // counter, the limit and the step are removed from the stack.
+    PARALLEL,
+    // REDUCE addr - an entry of the table: after the loop the i-th private
+    // words of all the threads are added to the word at address addr.
+    REDUCE,
+    // INPUT_BLOCK - addr, n: read n numbers into the data words from addr.
+    INPUT_BLOCK,
+    // PRINT_BLOCK - addr, n: print n data words from addr.
+    PRINT_BLOCK,
+    // PRINT_STACK n - print n words removed from the stack, the deepest
+    // first.
+    PRINT_STACK
 };
 
+// Size of the data memory of the virtual machine (in words) unless the
+// program header asks for more.
+const int DefaultMemorySize = 65536;
+
+// Returns true if the argument of the instruction is a code address. The
+// argument of CALL is the number of the procedure until the parser places the
+// procedures at the end of the program, so it is not relocated.
+bool HasCodeAddress(Instruction instruction);
+
 struct Command {
     Command(Instruction instruction);
-    Command(Instruction instruction, int arg);
-    void print(int address, std::ostream &os);
+    Command(Instruction instruction, Word arg);
+    void print(int address, TextWriter &writer) const;
 
     Instruction instruction;
-    int argument = 0;
+    Word argument = 0;
 };
 
 // Code generator.
 // Used for:
 // - Build a program for Milan virtual machine.
 // - Keep track of the last instruction address.
-// - Buffer the program and print to the output stream.
+// - Buffer the program and print to the output sink.
 class CodeGen {
 public:
-    explicit CodeGen(std::ostream &output);
+    // If stats is not null, the counters of the generated code and the output
+    // are added to it.
+    explicit CodeGen(OutputSink &output, CompileStats *stats = nullptr);
 
     // Append instruction without arguments to the program.
     void emit(Instruction instruction);
 
     // Append instruction with one arguments to the program.
-    void emit(Instruction instruction, int arg);
+    void emit(Instruction instruction, Word arg);
+
+    // Append the command to the program. Common sequences are replaced with
+    // the instructions with immediate and memory operands:
+    //   PUSH k; ADD / SUB / MULT  ->  ADDI k / SUBI k / MULI k
+    //   LOAD a; ADD               ->  ADDM a
+    //   LOAD a; ADDI 1; STORE a   ->  INC a (SUBI 1: DEC a)
+    // Operations on constants are folded:
+    //   PUSH j; PUSH k; ADD / SUB / MULT / DIV  ->  PUSH (j op k)
+    //   PUSH k; INVERT                          ->  PUSH -k
+    // A binary operation is folded only if its operands and the result fit
+    // in 32 bits, so that it gives the same result on every virtual machine.
+    // The instructions at the addresses returned by getCurrentAddress() may
+    // be jump targets, so they are never replaced.
+    void emit(const Command &command);
 
     // Set instruction without arguments at the specified address.
     void emitAt(int address, Instruction instruction);
 
     // Set instruction with one argument at the specified address.
-    void emitAt(int address, Instruction instruction, int arg);
+    void emitAt(int address, Instruction instruction, Word arg);
 
     // Get address after the last instruction.
     int getCurrentAddress();
 
+    // Get the command at the specified address.
+    const Command &getCommand(int address) const;
+
+    // Move the instructions emitted since the address middle before the
+    // instructions starting at the address first. Code addresses pointing
+    // into the moved instructions are adjusted; the address middle itself is
+    // taken as the end of the first part and becomes the end of the code.
+    void moveBefore(int first, int middle);
+
+    // Remove the instructions starting at the address and return them with
+    // their source lines. Code addresses become relative to the first
+    // removed instruction.
+    void cut(int start, std::vector<Command> &commands,
+             std::vector<int> &lines);
+
+    // Append the code removed by cut(), relocating its code addresses. The
+    // instructions are not combined.
+    void emitCode(const std::vector<Command> &commands,
+                  const std::vector<int> &lines);
+
     // Generate an "empty" instruction (NOP) and return its address.
     int reserve();
 
-    // Output instructions to the stream.
+    // Set the number of data words used by the program. If it exceeds the
+    // default memory size, the program starts with a MEMORY_SIZE header.
+    void setDataSize(int words);
+
+    // Replace the PUSH k; STORE a pairs at the start of the program with
+    // "SET a k" lines, which the virtual machine executes when loading the
+    // program. The pairs stop at the first jump target. The code addresses,
+    // including the arguments of CALL, are moved to the remaining code, so
+    // the procedures must be placed already.
+    void moveInitializersToData();
+
+    // Output instructions to the sink and close it.
     void flush();
 
+    // Set the source line of the instructions emitted from now on.
+    void setLine(int line);
+
+    // Output "address<TAB>line" for every instruction to the sink and close
+    // it. The virtual machine uses the map to attribute the profile to the
+    // source lines.
+    void printLineMap(OutputSink &output) const;
+
 private:
-    std::ostream &m_OutputStream;
+    // Append the command without combining it with the previous ones.
+    void append(const Command &command);
+
+    // Replace the last instructions and the command with one instruction if
+    // they form one of the sequences above. Returns true on success.
+    bool combine(const Command &command);
+
+    // Replace the instructions starting at the address with the command.
+    void replaceTail(int address, const Command &command);
+
+    OutputSink &m_Output;
     std::vector<Command> m_Commands;
+    // Source line of every instruction.
+    std::vector<int> m_Lines;
+    int m_Line = 0;
+    // The last address that may be a jump target.
+    int m_Label = 0;
+    int m_DataSize = 0;
+    // Addresses and initial values of the data words set by SET lines.
+    std::vector<std::pair<int, Word>> m_Data;
+    CompileStats *m_Stats;
 };
 
 #endif
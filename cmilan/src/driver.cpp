@@ -0,0 +1,185 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#include "driver.h"
+#include "incremental.h"
+#include "parser.h"
+#include "threadpool.h"
+
+namespace fs = std::filesystem;
+
+CompileResult CompileSource(const std::string &fileName, std::istream &input,
+                            CompileStats *stats, bool lineMap) {
+    BufferSink code;
+    std::ostringstream diagnostics;
+
+    Parser parser(fileName, input, code, diagnostics, stats);
+
+    CompileResult result;
+    result.success = parser.Parse();
+    result.code = code.take();
+    result.diagnostics = diagnostics.str();
+    if (lineMap && result.success) {
+        BufferSink map;
+        parser.PrintLineMap(map);
+        result.lineMap = map.take();
+    }
+    return result;
+}
+
+CompileResult CompileText(const std::string &fileName,
+                          const std::string &source,
+                          const CompileOptions &options) {
+    CompileResult result;
+    std::string key;
+    if (options.cache && !options.lineMap) {
+        key = CompileCache::Key(source);
+        if (options.cache->Lookup(key, result.code)) {
+            result.success = true;
+            result.stats.files = 1;
+            result.stats.cacheHits = 1;
+            return result;
+        }
+    }
+
+    CompileStats stats;
+    stats.files = 1;
+    CompileStats *statsPointer = options.collectStats ? &stats : nullptr;
+    if (!options.incrementalDirectory.empty() && !options.lineMap) {
+        result = CompileIncrementally(
+            fileName, source,
+            IncrementalStatePath(options.incrementalDirectory, fileName),
+            statsPointer);
+    } else {
+        std::istringstream input(source);
+        result = CompileSource(fileName, input, statsPointer, options.lineMap);
+    }
+    result.stats = stats;
+
+    if (options.cache && !options.lineMap && result.success) {
+        options.cache->Store(key, result.code);
+    }
+    return result;
+}
+
+bool ReadFile(const std::string &path, std::string &text) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return false;
+    }
+
+    std::ostringstream buffer;
+    buffer << input.rdbuf();
+    text = buffer.str();
+    return !input.bad();
+}
+
+// Write every line of the text to the stream prefixed with the file name.
+static void PrintDiagnostics(const std::string &fileName,
+                             const std::string &text, std::ostream &os) {
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        os << fileName << ": " << line << '\n';
+    }
+}
+
+static std::string OutputPath(const std::string &input,
+                              const std::string &outputDirectory) {
+    fs::path output = fs::path(outputDirectory) / fs::path(input).filename();
+    output.replace_extension(".ms");
+    return output.string();
+}
+
+bool CompileBatch(const std::vector<std::string> &inputs,
+                  const BatchOptions &options, CompileStats *stats) {
+    // Two inputs with the same name would overwrite each other's output.
+    std::vector<std::string> outputs;
+    std::set<std::string> seen;
+    for (const std::string &input : inputs) {
+        outputs.push_back(OutputPath(input, options.outputDirectory));
+        if (!seen.insert(outputs.back()).second) {
+            std::cerr << "Output file '" << outputs.back()
+                      << "' would be written twice (input '" << input << "')"
+                      << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::create_directories(options.outputDirectory, ec);
+    if (ec) {
+        std::cerr << "Unable to create directory '" << options.outputDirectory
+                  << "': " << ec.message() << std::endl;
+        return false;
+    }
+
+    unsigned jobs = options.jobs;
+    if (jobs == 0) {
+        jobs = std::thread::hardware_concurrency();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Every task owns its slot, so the results need no locking.
+    std::vector<CompileResult> results(inputs.size());
+    {
+        ThreadPool pool(jobs);
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            pool.Submit([&inputs, &outputs, &results, &options, i] {
+                CompileResult &result = results[i];
+
+                std::string source;
+                if (!ReadFile(inputs[i], source)) {
+                    result.diagnostics = "File not found\n";
+                    return;
+                }
+
+                result = CompileText(inputs[i], source, options.compile);
+                if (!result.success) {
+                    // Do not leave the code of a previous build in place.
+                    std::error_code ec;
+                    fs::remove(outputs[i], ec);
+                    return;
+                }
+
+                FileSink output(outputs[i]);
+                output.write(result.code.data(), result.code.size());
+                if (!output.close()) {
+                    result.success = false;
+                    result.diagnostics = "Unable to write '" + outputs[i] +
+                                         "'\n";
+                }
+            });
+        }
+        pool.Wait();
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        if (!results[i].success) {
+            ++failed;
+        }
+        if (stats) {
+            *stats += results[i].stats;
+        }
+        PrintDiagnostics(inputs[i], results[i].diagnostics, std::cerr);
+    }
+
+    double seconds = elapsed.count();
+    std::cerr << "Compiled " << inputs.size() << " files (" << failed
+              << " failed) in " << seconds << " s";
+    if (seconds > 0) {
+        std::cerr << ", " << inputs.size() / seconds << " files/sec";
+    }
+    std::cerr << std::endl;
+
+    return failed == 0;
+}
@@ -0,0 +1,74 @@
+#ifndef CMILAN_DRIVER_H
+#define CMILAN_DRIVER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "stats.h"
+
+// Result of compiling a single program.
+struct CompileResult {
+    bool success = false;
+    // Code for the virtual machine (empty if errors were found).
+    std::string code;
+    // Error messages in the order they were reported.
+    std::string diagnostics;
+    // Filled if CompileOptions::collectStats is set.
+    CompileStats stats;
+    // Map from the code addresses to the source lines, filled if
+    // CompileOptions::lineMap is set.
+    std::string lineMap;
+};
+
+// Options of a single compilation.
+struct CompileOptions {
+    // Cache of the generated code, may be null.
+    CompileCache *cache = nullptr;
+    // Directory of the incremental compilation state, empty if the programs
+    // are compiled from scratch.
+    std::string incrementalDirectory;
+    // Collect the counters and timings of the compilation phases.
+    bool collectStats = false;
+    // Produce the line map. The program is then compiled from scratch, since
+    // neither the cache nor the incremental state keep the source lines.
+    bool lineMap = false;
+};
+
+// Options of the batch compilation.
+struct BatchOptions {
+    CompileOptions compile;
+    // Directory for the generated files.
+    std::string outputDirectory;
+    // Number of worker threads, 0 means one per hardware thread.
+    unsigned jobs = 0;
+};
+
+// Compile the program read from the input. Each call uses its own scanner,
+// parser and code generator, so it is safe to call from several threads.
+// If stats is not null, the counters of the compilation are added to it.
+// If lineMap is set, the result includes the line map.
+CompileResult CompileSource(const std::string &fileName, std::istream &input,
+                            CompileStats *stats = nullptr,
+                            bool lineMap = false);
+
+// Compile the source text. If the code for the same text is in the cache, it
+// is returned without scanning and parsing the program. The code of a
+// successful compilation is added to the cache.
+CompileResult CompileText(const std::string &fileName,
+                          const std::string &source,
+                          const CompileOptions &options);
+
+// Read the whole file into the text. Returns false if the file can't be read.
+bool ReadFile(const std::string &path, std::string &text);
+
+// Compile every input file into outputDirectory/<name>.ms using a pool of
+// worker threads. Diagnostics are printed to stderr grouped by file in the
+// order of the inputs, followed by the summary. If stats is not null, the
+// counters of all the files are added to it.
+// Returns true if all the files were compiled successfully.
+bool CompileBatch(const std::vector<std::string> &inputs,
+                  const BatchOptions &options, CompileStats *stats = nullptr);
+
+#endif // CMILAN_DRIVER_H
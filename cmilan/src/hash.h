@@ -0,0 +1,30 @@
+#ifndef CMILAN_HASH_H
+#define CMILAN_HASH_H
+
+#include <cstdint>
+#include <string>
+
+const std::uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+
+// 64-bit FNV-1a hash of the data. Pass the previous result as hash to hash
+// several pieces of data.
+inline std::uint64_t Fnv1a(const std::string &data,
+                           std::uint64_t hash = FNV_OFFSET_BASIS) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Hash as 16 hexadecimal digits.
+inline std::string HashToString(std::uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i, hash >>= 4) {
+        text[i] = digits[hash & 0xf];
+    }
+    return text;
+}
+
+#endif // CMILAN_HASH_H
@@ -0,0 +1,422 @@
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "incremental.h"
+#include "output.h"
+#include "parser.h"
+#include "version.h"
+
+namespace fs = std::filesystem;
+
+static const char *s_StateHeader = "cmilan-incremental";
+
+namespace {
+
+// Top-level statement of the program.
+struct Statement {
+    std::string text;
+    // Line of the first lexeme of the statement.
+    int line;
+    std::uint64_t fingerprint;
+};
+
+struct Fragment {
+    // Variables used by the statement and their addresses in the order of
+    // first use.
+    std::vector<std::pair<std::string, int>> variables;
+    // Code of the statement. Code addresses are relative to the fragment.
+    std::vector<Command> commands;
+};
+
+using FragmentTable = std::unordered_map<std::uint64_t, Fragment>;
+
+} // namespace
+
+static bool IsLetter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+           c == '\f';
+}
+
+static bool IsKeyword(const char *word, std::size_t length,
+                      const char *keyword) {
+    std::size_t i = 0;
+    for (; i < length && keyword[i]; ++i) {
+        if ((word[i] | 0x20) != keyword[i]) {
+            return false;
+        }
+    }
+    return i == length && !keyword[i];
+}
+
+// Skip spaces and comments the same way the scanner does. Returns false if
+// a comment is not closed.
+static bool SkipSpace(const std::string &source, std::size_t &position,
+                      int &line) {
+    for (;;) {
+        while (position < source.size() && IsSpace(source[position])) {
+            if (source[position++] == '\n') {
+                ++line;
+            }
+        }
+        if (source.compare(position, 2, "/*") != 0) {
+            return true;
+        }
+        std::size_t end = source.find("*/", position + 2);
+        if (end == std::string::npos) {
+            return false;
+        }
+        for (; position < end + 2; ++position) {
+            if (source[position] == '\n') {
+                ++line;
+            }
+        }
+    }
+}
+
+// Split the program into top-level statements. Returns false if the program
+// is not a well-formed BEGIN ... END block. This is much cheaper than
+// running the scanner: only the words and the semicolons matter here, all
+// the other lexemes are checked when a statement is parsed.
+static bool SplitProgram(const std::string &source,
+                         std::vector<Statement> &statements) {
+    std::size_t position = 0;
+    int line = 1;
+
+    // Find the next word or semicolon.
+    const char *word = nullptr;
+    std::size_t wordLength = 0;
+    auto next = [&]() {
+        for (;;) {
+            if (!SkipSpace(source, position, line) ||
+                position == source.size()) {
+                return false;
+            }
+            char c = source[position];
+            if (c == ';') {
+                word = &source[position++];
+                wordLength = 1;
+                return true;
+            } else if (IsLetter(c)) {
+                std::size_t start = position;
+                while (position < source.size() &&
+                       (IsLetter(source[position]) ||
+                        IsDigit(source[position]))) {
+                    ++position;
+                }
+                word = &source[start];
+                wordLength = position - start;
+                return true;
+            }
+            ++position;
+        }
+    };
+
+    // Programs with procedures start with PROCEDURE and are compiled as a
+    // whole.
+    if (!next() || !IsKeyword(word, wordLength, "begin")) {
+        return false;
+    }
+    if (!next()) {
+        return false;
+    }
+
+    if (!IsKeyword(word, wordLength, "end")) {
+        for (;;) {
+            std::size_t start = word - source.data();
+            int startLine = line;
+
+            // IF ... FI, DO ... OD and CASE ... ESAC blocks may contain
+            // semicolons.
+            int depth = 0;
+            while (depth > 0 || (*word != ';' &&
+                                 !IsKeyword(word, wordLength, "end"))) {
+                // Fragments do not record the array sizes, the values of the
+                // constants and the names private to PARALLEL FOR (a later
+                // statement may make such a name shared), so programs with
+                // arrays, constants or parallel loops are compiled as a
+                // whole.
+                if (IsKeyword(word, wordLength, "array") ||
+                    IsKeyword(word, wordLength, "const") ||
+                    IsKeyword(word, wordLength, "parallel")) {
+                    return false;
+                }
+                if (IsKeyword(word, wordLength, "if") ||
+                    IsKeyword(word, wordLength, "do") ||
+                    IsKeyword(word, wordLength, "case")) {
+                    ++depth;
+                } else if (IsKeyword(word, wordLength, "fi") ||
+                           IsKeyword(word, wordLength, "od") ||
+                           IsKeyword(word, wordLength, "esac")) {
+                    if (--depth < 0) {
+                        return false;
+                    }
+                }
+                if (!next()) {
+                    return false;
+                }
+            }
+
+            std::size_t end = word - source.data();
+            std::string text = source.substr(start, end - start);
+            statements.push_back({text, startLine, Fnv1a(text)});
+
+            if (*word != ';') {
+                break;
+            }
+            if (!next()) {
+                return false;
+            }
+        }
+    }
+
+    // Nothing but spaces and comments may follow END.
+    return SkipSpace(source, position, line) && position == source.size();
+}
+
+template <typename T>
+static bool ReadNumber(const char *&text, const char *end, T &value) {
+    std::from_chars_result result = std::from_chars(text, end, value);
+    if (result.ec != std::errc()) {
+        return false;
+    }
+    text = result.ptr;
+    while (text < end && IsSpace(*text)) {
+        ++text;
+    }
+    return true;
+}
+
+static bool ReadWord(const char *&text, const char *end, std::string &word) {
+    const char *start = text;
+    while (text < end && !IsSpace(*text)) {
+        ++text;
+    }
+    word.assign(start, text);
+    while (text < end && IsSpace(*text)) {
+        ++text;
+    }
+    return !word.empty();
+}
+
+static FragmentTable LoadState(const std::string &statePath) {
+    FragmentTable fragments;
+
+    std::string state;
+    if (!ReadFile(statePath, state)) {
+        return fragments;
+    }
+
+    const char *text = state.data();
+    const char *end = text + state.size();
+    std::string header;
+    std::string version;
+    if (!ReadWord(text, end, header) || header != s_StateHeader ||
+        !ReadWord(text, end, version) || version != CMILAN_VERSION) {
+        return fragments;
+    }
+
+    std::string word;
+    while (text < end) {
+        std::uint64_t fingerprint;
+        long variableCount;
+        long commandCount;
+        if (!ReadWord(text, end, word) ||
+            std::from_chars(word.data(), word.data() + word.size(),
+                            fingerprint, 16)
+                    .ec != std::errc() ||
+            !ReadWord(text, end, word) ||
+            !ReadNumber(text, end, variableCount) ||
+            !ReadNumber(text, end, commandCount)) {
+            // Damaged state file, start from scratch.
+            return FragmentTable();
+        }
+
+        Fragment fragment;
+        for (long i = 0; i < variableCount; ++i) {
+            long address;
+            if (!ReadWord(text, end, word) ||
+                !ReadNumber(text, end, address)) {
+                return FragmentTable();
+            }
+            fragment.variables.emplace_back(word, address);
+        }
+        fragment.commands.reserve(commandCount);
+        for (long i = 0; i < commandCount; ++i) {
+            long instruction;
+            Word argument;
+            if (!ReadNumber(text, end, instruction) ||
+                !ReadNumber(text, end, argument)) {
+                return FragmentTable();
+            }
+            fragment.commands.emplace_back(
+                static_cast<Instruction>(instruction), argument);
+        }
+        fragments[fingerprint] = std::move(fragment);
+    }
+
+    return fragments;
+}
+
+static void AppendNumber(std::string &text, long long value, char separator) {
+    char buffer[24];
+    std::to_chars_result result =
+        std::to_chars(buffer, buffer + sizeof(buffer), value);
+    text.append(buffer, result.ptr);
+    text += separator;
+}
+
+static void SaveState(const std::string &statePath,
+                      const FragmentTable &fragments) {
+    std::string state = s_StateHeader;
+    state += ' ';
+    state += CMILAN_VERSION;
+    state += '\n';
+    for (const auto &[fingerprint, fragment] : fragments) {
+        // The first word is the fingerprint, the second one makes the
+        // line easier to find when reading the file.
+        state += HashToString(fingerprint);
+        state += " fragment ";
+        AppendNumber(state, fragment.variables.size(), ' ');
+        AppendNumber(state, fragment.commands.size(), '\n');
+        for (const auto &[name, address] : fragment.variables) {
+            state += name;
+            state += ' ';
+            AppendNumber(state, address, '\n');
+        }
+        for (const Command &command : fragment.commands) {
+            AppendNumber(state, command.instruction, ' ');
+            AppendNumber(state, command.argument, '\n');
+        }
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(statePath).parent_path(), ec);
+
+    // Other compilations of the same file may read the state meanwhile.
+    std::string temporary = statePath + ".tmp";
+    FileSink file(temporary);
+    file.write(state.data(), state.size());
+    if (!file.close()) {
+        fs::remove(temporary, ec);
+        return;
+    }
+    fs::rename(temporary, statePath, ec);
+}
+
+// Add the variables of the fragment to the table if they can get the same
+// addresses. Returns false (and leaves the table intact) otherwise.
+static bool BindVariables(const Fragment &fragment, SymbolTable &symbols) {
+    int nextAddress = symbols.lastVariable;
+    for (const auto &[name, address] : fragment.variables) {
+        auto it = symbols.variables.find(name);
+        if (it != symbols.variables.end() ? it->second != address
+                                          : address != nextAddress++) {
+            return false;
+        }
+    }
+
+    for (const auto &[name, address] : fragment.variables) {
+        if (symbols.variables.emplace(name, address).second) {
+            symbols.lastVariable = address + 1;
+        }
+    }
+    return true;
+}
+
+std::string IncrementalStatePath(const std::string &directory,
+                                 const std::string &fileName) {
+    return (fs::path(directory) / (HashToString(Fnv1a(fileName)) + ".inc"))
+        .string();
+}
+
+CompileResult CompileIncrementally(const std::string &fileName,
+                                   const std::string &source,
+                                   const std::string &statePath,
+                                   CompileStats *stats) {
+    std::vector<Statement> statements;
+    if (!SplitProgram(source, statements)) {
+        std::istringstream input(source);
+        return CompileSource(fileName, input, stats);
+    }
+
+    FragmentTable previous = LoadState(statePath);
+    FragmentTable fragments;
+
+    BufferSink code;
+    std::ostringstream diagnostics;
+    CodeGen codegen(code, stats);
+    SymbolTable symbols;
+
+    for (const Statement &statement : statements) {
+        int start = codegen.getCurrentAddress();
+
+        // The same statement may occur several times, so the fragment may
+        // have already been moved to the new table.
+        FragmentTable::iterator it = previous.find(statement.fingerprint);
+        if (it != previous.end()) {
+            it = fragments.insert(previous.extract(it)).position;
+        } else {
+            it = fragments.find(statement.fingerprint);
+        }
+
+        if (it != fragments.end() && BindVariables(it->second, symbols)) {
+            // The fragment is copied as it is: combining its instructions
+            // again would move the addresses its jumps refer to.
+            const std::vector<Command> &commands = it->second.commands;
+            std::vector<int> lines(commands.size(), statement.line);
+            codegen.emitCode(commands, lines);
+            if (stats) {
+                ++stats->reusedStatements;
+            }
+            continue;
+        }
+
+        std::istringstream input(statement.text);
+        Parser parser(fileName, input, statement.line, diagnostics, codegen,
+                      symbols, stats);
+        std::vector<std::string> references;
+        if (!parser.ParseStatement(references)) {
+            std::istringstream whole(source);
+            return CompileSource(fileName, whole, stats);
+        }
+
+        Fragment &fragment = fragments[statement.fingerprint];
+        fragment = Fragment();
+        for (const std::string &name : references) {
+            fragment.variables.emplace_back(name, symbols.variables[name]);
+        }
+        int end = codegen.getCurrentAddress();
+        for (int address = start; address < end; ++address) {
+            Command command = codegen.getCommand(address);
+            if (HasCodeAddress(command.instruction)) {
+                command.argument -= start;
+            }
+            fragment.commands.push_back(command);
+        }
+    }
+
+    codegen.emit(STOP);
+    codegen.moveInitializersToData();
+    codegen.setDataSize(symbols.lastVariable);
+    codegen.flush();
+    SaveState(statePath, fragments);
+
+    CompileResult result;
+    result.success = true;
+    result.code = code.take();
+    return result;
+}
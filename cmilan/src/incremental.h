@@ -0,0 +1,40 @@
+#ifndef CMILAN_INCREMENTAL_H
+#define CMILAN_INCREMENTAL_H
+
+#include <string>
+
+#include "driver.h"
+
+/* Incremental compilation.
+ *
+ * The body of a program is a list of top-level statements. For every one of
+ * them the compiler saves a fingerprint (hash of the statement text) and the
+ * generated code fragment in a state file. On the next compilation of the
+ * same file the fragments of the unchanged statements are copied to the new
+ * program: the jump addresses are kept relative to the start of the fragment
+ * and relocated to its new position. Only the changed statements are parsed
+ * again; a change inside an IF or WHILE block recompiles the top-level
+ * statement enclosing it.
+ *
+ * Variables get their addresses in the order of first use, so a fragment is
+ * reused only if all its variables still have the same addresses. Otherwise
+ * the statement is recompiled.
+ *
+ * If the program contains errors, parallel loops or declares arrays,
+ * constants or procedures, it is compiled as a whole (in the first case to
+ * report the same diagnostics as the usual compilation does).
+ * */
+
+// Path of the state file of the source file in the state directory.
+std::string IncrementalStatePath(const std::string &directory,
+                                 const std::string &fileName);
+
+// Compile the source text reusing the fragments from the state file and
+// save the new state.
+// If stats is not null, the counters of the compilation are added to it.
+CompileResult CompileIncrementally(const std::string &fileName,
+                                   const std::string &source,
+                                   const std::string &statePath,
+                                   CompileStats *stats = nullptr);
+
+#endif // CMILAN_INCREMENTAL_H
@@ -1,11 +1,58 @@
+#include <cstdio>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include "parser.h"
+#include "driver.h"
+#include "output.h"
+#include "server.h"
+
+// Default bound of the compile cache size.
+static const std::uintmax_t s_DefaultCacheSize = 64 * 1024 * 1024;
 
 void PrintHelp() {
-    std::cout << "Usage: cmilan input_file" << std::endl;
+    std::cout << "Usage: cmilan [options] [-o output_file] input_file"
+              << std::endl;
+    std::cout << "       cmilan [options] [-j jobs] -d output_dir input_file..."
+              << std::endl;
+    std::cout << "       cmilan [options] [-j jobs] --serve socket"
+              << std::endl;
+    std::cout << "       cmilan --connect socket input_file" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --cache dir         reuse the code of unchanged programs"
+              << std::endl;
+    std::cout << "  --cache-size bytes  bound of the cache size (default "
+              << s_DefaultCacheSize << ")" << std::endl;
+    std::cout << "  --cache-stats       print cache hits and misses"
+              << std::endl;
+    std::cout << "  --incremental dir   recompile only the changed statements"
+              << std::endl;
+    std::cout << "  --time-report[=json]  print time and counters of the phases"
+              << std::endl;
+    std::cout << "  --line-map file     write the source line of every address "
+                 "(for mvm --profile)"
+              << std::endl;
+}
+
+bool WriteOutput(const std::string &path, const std::string &text) {
+    FileSink output(path);
+    output.write(text.data(), text.size());
+    if (!output.close()) {
+        std::cerr << "Unable to write '" << path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PrintCacheStats(const CompileCache &cache) {
+    CompileCache::Stats stats = cache.GetStats();
+    std::cerr << "Cache: " << stats.hits << " hits, " << stats.misses
+              << " misses, " << stats.stores << " stores, " << stats.evictions
+              << " evictions" << std::endl;
 }
 
 int main(int argc, char **argv) {
@@ -14,15 +61,132 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    std::ifstream input;
-    input.open(argv[1]);
+    BatchOptions options;
+    std::vector<std::string> inputs;
+    std::string cacheDirectory;
+    std::uintmax_t cacheSize = s_DefaultCacheSize;
+    bool cacheStats = false;
+    bool timeReport = false;
+    bool timeReportJson = false;
+    std::string outputFile;
+    std::string lineMapFile;
+    std::string serveSocket;
+    std::string connectSocket;
 
-    if (input) {
-        Parser p(argv[1], input);
-        p.Parse();
-        return EXIT_SUCCESS;
-    } else {
-        std::cerr << "File '" << argv[1] << "' not found" << std::endl;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            options.outputDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--line-map") == 0 && i + 1 < argc) {
+            lineMapFile = argv[++i];
+            options.compile.lineMap = true;
+        } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.jobs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--cache-size") == 0 &&
+                   i + 1 < argc) {
+            cacheSize = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--cache-stats") == 0) {
+            cacheStats = true;
+        } else if (std::strcmp(argv[i], "--incremental") == 0 &&
+                   i + 1 < argc) {
+            options.compile.incrementalDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--time-report") == 0 ||
+                   std::strcmp(argv[i], "--time-report=json") == 0) {
+            timeReport = true;
+            timeReportJson = argv[i][13] == '=';
+            options.compile.collectStats = true;
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (std::strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connectSocket = argv[++i];
+        } else if (argv[i][0] == '-') {
+            PrintHelp();
+            return EXIT_FAILURE;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (!lineMapFile.empty() &&
+        (!options.outputDirectory.empty() || !serveSocket.empty() ||
+         !connectSocket.empty())) {
+        std::cerr << "--line-map needs a single input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<CompileCache> cache;
+    if (!cacheDirectory.empty()) {
+        cache = std::make_unique<CompileCache>(cacheDirectory, cacheSize);
+        options.compile.cache = cache.get();
+    }
+
+    if (!connectSocket.empty()) {
+        if (inputs.size() != 1) {
+            PrintHelp();
+            return EXIT_FAILURE;
+        }
+        return RunClient(connectSocket, inputs[0]);
+    }
+
+    CompileStats::Clock::time_point start = CompileStats::Clock::now();
+    CompileStats stats;
+
+    int status = EXIT_SUCCESS;
+    if (!serveSocket.empty()) {
+        status = RunServer(serveSocket, options.compile, options.jobs);
+    } else if (!options.outputDirectory.empty()) {
+        if (!CompileBatch(inputs, options, &stats)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (inputs.size() != 1) {
+        PrintHelp();
         return EXIT_FAILURE;
+    } else {
+        std::string source;
+        if (ReadFile(inputs[0], source)) {
+            CompileResult result =
+                CompileText(inputs[0], source, options.compile);
+            if (outputFile.empty()) {
+                std::cout << result.code;
+                std::cout.flush();
+            }
+            if (!result.success) {
+                // The files of a previous build must not be taken for the
+                // result of this one.
+                if (!outputFile.empty()) {
+                    std::remove(outputFile.c_str());
+                }
+                if (!lineMapFile.empty()) {
+                    std::remove(lineMapFile.c_str());
+                }
+                status = EXIT_FAILURE;
+            } else {
+                if (!outputFile.empty() &&
+                    !WriteOutput(outputFile, result.code)) {
+                    status = EXIT_FAILURE;
+                }
+                if (!lineMapFile.empty() &&
+                    !WriteOutput(lineMapFile, result.lineMap)) {
+                    status = EXIT_FAILURE;
+                }
+            }
+            std::cerr << result.diagnostics;
+            stats = result.stats;
+        } else {
+            std::cerr << "File '" << inputs[0] << "' not found" << std::endl;
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if (cache && cacheStats) {
+        PrintCacheStats(*cache);
+    }
+    if (timeReport && serveSocket.empty()) {
+        PrintTimeReport(stats, SecondsSince(start), timeReportJson,
+                        std::cerr);
     }
+    return status;
 }
@@ -0,0 +1,122 @@
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "output.h"
+
+StreamSink::StreamSink(std::ostream &output) : m_OutputStream(output) {}
+
+void StreamSink::write(const char *data, std::size_t size) {
+    m_OutputStream.write(data, size);
+}
+
+bool StreamSink::close() {
+    m_OutputStream.flush();
+    return static_cast<bool>(m_OutputStream);
+}
+
+void BufferSink::write(const char *data, std::size_t size) {
+    m_Buffer.append(data, size);
+}
+
+const std::string &BufferSink::buffer() const {
+    return m_Buffer;
+}
+
+std::string BufferSink::take() {
+    return std::move(m_Buffer);
+}
+
+FileSink::FileSink(const std::string &path) : m_Path(path) {}
+
+void FileSink::write(const char *data, std::size_t size) {
+    m_Buffer.append(data, size);
+}
+
+bool FileSink::close() {
+    int fd = open(m_Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+
+    // A regular file normally takes the whole buffer at once, but write()
+    // is allowed to be partial.
+    const char *data = m_Buffer.data();
+    std::size_t size = m_Buffer.size();
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            ::close(fd);
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return ::close(fd) == 0;
+}
+
+TextWriter::TextWriter(OutputSink &sink)
+    : m_Sink(sink), m_Block(new char[BLOCK_SIZE]) {}
+
+TextWriter::~TextWriter() {
+    flush();
+}
+
+void TextWriter::reserve(std::size_t size) {
+    if (m_Used + size > BLOCK_SIZE) {
+        flush();
+    }
+}
+
+void TextWriter::write(char c) {
+    reserve(1);
+    m_Block[m_Used++] = c;
+}
+
+void TextWriter::write(const char *text) {
+    std::size_t size = std::strlen(text);
+    if (size > BLOCK_SIZE) {
+        flush();
+        m_Sink.write(text, size);
+        m_Flushed += size;
+        return;
+    }
+    reserve(size);
+    std::memcpy(&m_Block[m_Used], text, size);
+    m_Used += size;
+}
+
+void TextWriter::writeNumber(long long value) {
+    // Digits are produced from the end of the temporary buffer.
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+
+    // The magnitude is computed as unsigned to handle the minimal value.
+    unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    std::size_t size = end - p;
+    reserve(size);
+    std::memcpy(&m_Block[m_Used], p, size);
+    m_Used += size;
+}
+
+void TextWriter::flush() {
+    if (m_Used > 0) {
+        m_Sink.write(m_Block.get(), m_Used);
+        m_Flushed += m_Used;
+        m_Used = 0;
+    }
+}
+
+long TextWriter::count() const {
+    return m_Flushed + m_Used;
+}
@@ -0,0 +1,99 @@
+#ifndef CMILAN_OUTPUT_H
+#define CMILAN_OUTPUT_H
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// Destination of the generated code.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Append the block of text to the output.
+    virtual void write(const char *data, std::size_t size) = 0;
+
+    // Finish the output. Returns false if the text could not be written.
+    virtual bool close() {
+        return true;
+    }
+};
+
+// Writes the text to the output stream.
+class StreamSink : public OutputSink {
+public:
+    explicit StreamSink(std::ostream &output);
+
+    void write(const char *data, std::size_t size) override;
+    bool close() override;
+
+private:
+    std::ostream &m_OutputStream;
+};
+
+// Keeps the text in memory, for using the compiler as a library.
+class BufferSink : public OutputSink {
+public:
+    void write(const char *data, std::size_t size) override;
+
+    const std::string &buffer() const;
+
+    // Move the text out of the sink.
+    std::string take();
+
+private:
+    std::string m_Buffer;
+};
+
+// Collects the whole text and writes it to the file with a single system
+// call on close().
+class FileSink : public OutputSink {
+public:
+    explicit FileSink(const std::string &path);
+
+    void write(const char *data, std::size_t size) override;
+    bool close() override;
+
+private:
+    const std::string m_Path;
+    std::string m_Buffer;
+};
+
+// Block-buffered text writer. The text is formatted into a fixed-size block
+// which is passed to the sink when it is full, so the sink is called once per
+// block instead of once per line.
+class TextWriter {
+public:
+    explicit TextWriter(OutputSink &sink);
+
+    // Pass the buffered text to the sink.
+    ~TextWriter();
+
+    TextWriter(const TextWriter &) = delete;
+    TextWriter &operator=(const TextWriter &) = delete;
+
+    void write(char c);
+    void write(const char *text);
+    void writeNumber(long long value);
+
+    // Pass the buffered text to the sink.
+    void flush();
+
+    // Number of characters written so far.
+    long count() const;
+
+private:
+    // Make room for at least size characters in the block.
+    void reserve(std::size_t size);
+
+private:
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+
+    OutputSink &m_Sink;
+    std::unique_ptr<char[]> m_Block;
+    std::size_t m_Used = 0;
+    long m_Flushed = 0;
+};
+
+#endif // CMILAN_OUTPUT_H
@@ -1,10 +1,111 @@
+#include <algorithm>
 #include <sstream>
 
 #include "parser.h"
 
-Parser::Parser(const std::string &fileName, std::istream &input)
-    : m_OutputStream(std::cout), m_Scanner(fileName, input),
-      m_Codegen(m_OutputStream) {
+namespace {
+
+// vadd(dst, a, b, n), vmul(dst, a, b, n), vfill(dst, n, value),
+// vcopy(dst, src, n) and the function vsum(a, n).
+const Builtin s_Builtins[] = {
+    {"vadd", VADD, 3, 1, false},  {"vmul", VMUL, 3, 1, false},
+    {"vsum", VSUM, 1, 1, true},   {"vfill", VFILL, 1, 2, false},
+    {"vcopy", VCOPY, 2, 1, false},
+};
+
+enum class ConstantValue { Known, Unknown, OutOfRange, DivisionByZero };
+
+// Evaluate the code of an expression made of numbers at the width of Word.
+// The code generator folds only the operations giving the same result on
+// every virtual machine, so a larger constant is left as instructions.
+ConstantValue Evaluate(const std::vector<Command> &code, Word &value) {
+    std::vector<Word> stack;
+    for (const Command &command : code) {
+        Instruction instruction = command.instruction;
+        switch (instruction) {
+        case PUSH:
+            stack.push_back(command.argument);
+            continue;
+        case INVERT:
+            if (stack.empty()) {
+                return ConstantValue::Unknown;
+            }
+            if (stack.back() == INT64_MIN) {
+                return ConstantValue::OutOfRange;
+            }
+            stack.back() = -stack.back();
+            continue;
+        case ADDI:
+        case SUBI:
+        case MULI:
+            stack.push_back(command.argument);
+            instruction = instruction == ADDI   ? ADD
+                          : instruction == SUBI ? SUB
+                                                : MULT;
+            break;
+        case ADD:
+        case SUB:
+        case MULT:
+        case DIV:
+            break;
+        default:
+            return ConstantValue::Unknown;
+        }
+
+        if (stack.size() < 2) {
+            return ConstantValue::Unknown;
+        }
+        Word k = stack.back();
+        stack.pop_back();
+        Word &j = stack.back();
+        bool overflow = false;
+        switch (instruction) {
+        case ADD:
+            overflow = __builtin_add_overflow(j, k, &j);
+            break;
+        case SUB:
+            overflow = __builtin_sub_overflow(j, k, &j);
+            break;
+        case MULT:
+            overflow = __builtin_mul_overflow(j, k, &j);
+            break;
+        default:
+            if (k == 0) {
+                return ConstantValue::DivisionByZero;
+            }
+            overflow = j == INT64_MIN && k == -1;
+            if (!overflow) {
+                j /= k;
+            }
+            break;
+        }
+        if (overflow) {
+            return ConstantValue::OutOfRange;
+        }
+    }
+    if (stack.size() != 1) {
+        return ConstantValue::Unknown;
+    }
+    value = stack.back();
+    return ConstantValue::Known;
+}
+
+} // namespace
+
+Parser::Parser(const std::string &fileName, std::istream &input,
+               OutputSink &output, std::ostream &errors,
+               CompileStats *stats)
+    : m_ErrorStream(errors), m_Scanner(fileName, input, 1, stats),
+      m_OwnCodegen(std::make_unique<CodeGen>(output, stats)),
+      m_Codegen(*m_OwnCodegen), m_Symbols(m_OwnSymbols), m_Stats(stats) {
+    Next();
+}
+
+Parser::Parser(const std::string &fileName, std::istream &input,
+               int lineNumber, std::ostream &errors, CodeGen &codegen,
+               SymbolTable &symbols, CompileStats *stats)
+    : m_ErrorStream(errors), m_Scanner(fileName, input, lineNumber, stats),
+      m_Codegen(codegen), m_Symbols(symbols), m_Stats(stats) {
     Next();
 }
 
@@ -12,6 +113,10 @@ bool Parser::See(Token t) {
     return m_Scanner.GetCurrentToken() == t;
 }
 
+bool Parser::SeeWord(const char *word) {
+    return See(Token::Identifier) && m_Scanner.GetStringValue() == word;
+}
+
 bool Parser::Match(Token t) {
     if (m_Scanner.GetCurrentToken() == t) {
         m_Scanner.ExtractNextToken();
@@ -26,34 +131,432 @@ void Parser::Next() {
 }
 
 void Parser::ReportError(const std::string &message) {
-    std::cerr << "Line " << m_Scanner.GetLineNumber() << ": " << message
-              << std::endl;
+    m_ErrorStream << "Line " << m_Scanner.GetLineNumber() << ": " << message
+                  << std::endl;
     m_IsError = true;
+    if (m_Stats) {
+        ++m_Stats->errors;
+    }
+}
+
+void Parser::TimeParsing(void (Parser::*nonTerminal)()) {
+    if (!m_Stats) {
+        (this->*nonTerminal)();
+        return;
+    }
+
+    CompileStats::Clock::time_point start = CompileStats::Clock::now();
+    double scanSeconds = m_Stats->scanSeconds;
+    (this->*nonTerminal)();
+    m_Stats->parseSeconds +=
+        SecondsSince(start) - (m_Stats->scanSeconds - scanSeconds);
 }
 
-void Parser::Parse() {
-    Program();
+bool Parser::Parse() {
+    TimeParsing(&Parser::Program);
     if (!m_IsError) {
+        m_Codegen.moveInitializersToData();
+        m_Codegen.setDataSize(m_Symbols.lastVariable);
         m_Codegen.flush();
     }
+    return !m_IsError;
+}
+
+void Parser::PrintLineMap(OutputSink &output) const {
+    m_Codegen.printLineMap(output);
+}
+
+bool Parser::ParseStatement(std::vector<std::string> &references) {
+    m_References = &references;
+    TimeParsing(&Parser::Statement);
+    m_References = nullptr;
+
+    if (!See(Token::Eof)) {
+        ReportError("end of statement expected.");
+    }
+    return !m_IsError;
 }
 
 void Parser::Program() {
+    // The arrays and the constants used by the procedures are declared
+    // before them. A declaration may be followed by a semicolon.
+    while (See(Token::Procedure) || See(Token::Array) || See(Token::Const)) {
+        if (Match(Token::Procedure)) {
+            ProcedureDeclaration();
+        } else {
+            Statement();
+        }
+        Match(Token::Semicolon);
+    }
     MustBe(Token::Begin);
     StatementList();
+    m_Codegen.setLine(m_Scanner.GetLineNumber());
     MustBe(Token::End);
     m_Codegen.emit(STOP);
+    PlaceProcedures();
+}
+
+void Parser::ProcedureDeclaration() {
+    // PROCEDURE name(a, b) BEGIN ... END
+    //
+    // The parameters are passed by value in words of their own, other names
+    // refer to the variables of the program. Since the parameters are not
+    // on the stack, a procedure may call only the procedures declared before
+    // it, and recursion is not allowed. The body is compiled at the end of
+    // the code and then cut from it.
+    m_Codegen.setLine(m_Scanner.GetLineNumber());
+    std::string name;
+    if (See(Token::Identifier)) {
+        name = m_Scanner.GetStringValue();
+        Next();
+        if (m_ProcedureNumbers.count(name)) {
+            ReportError("procedure '" + name + "' is already declared.");
+        } else if (FindBuiltin(name)) {
+            ReportError("'" + name + "' is a built-in procedure.");
+        }
+    } else {
+        ReportError("procedure name expected.");
+    }
+
+    Procedure procedure;
+    m_Parameters.clear();
+    MustBe(Token::LeftParen);
+    if (!See(Token::RightParen)) {
+        do {
+            if (!See(Token::Identifier)) {
+                ReportError("parameter name expected.");
+                break;
+            }
+            std::string parameter = m_Scanner.GetStringValue();
+            Next();
+            if (m_Parameters.count(parameter)) {
+                ReportError("duplicate parameter '" + parameter + "'.");
+            } else {
+                m_Parameters[parameter] = m_Symbols.lastVariable;
+                procedure.parameters.push_back(m_Symbols.lastVariable++);
+            }
+        } while (Match(Token::Comma));
+    }
+    MustBe(Token::RightParen);
+
+    m_ProcedureName = name;
+    int start = m_Codegen.getCurrentAddress();
+    MustBe(Token::Begin);
+    StatementList();
+    procedure.endLine = m_Scanner.GetLineNumber();
+    MustBe(Token::End);
+    m_Codegen.cut(start, procedure.code, procedure.lines);
+    m_ProcedureName.clear();
+    m_Parameters.clear();
+
+    if (!name.empty() && !m_ProcedureNumbers.count(name)) {
+        m_ProcedureNumbers[name] = m_Procedures.size();
+        m_Procedures.push_back(std::move(procedure));
+    }
+}
+
+void Parser::Call(const std::string &name) {
+    // The arguments are left on the stack and stored to the parameters
+    // starting from the last one.
+    size_t count = 0;
+    if (!See(Token::RightParen)) {
+        do {
+            Expression();
+            ++count;
+        } while (Match(Token::Comma));
+    }
+    MustBe(Token::RightParen);
+
+    // The parameters and the variables of a procedure are shared by the
+    // threads of a parallel loop.
+    if (m_Parallel) {
+        ReportError("procedures cannot be called in PARALLEL FOR.");
+        return;
+    }
+
+    std::map<std::string, int>::const_iterator it =
+        m_ProcedureNumbers.find(name);
+    if (it == m_ProcedureNumbers.end()) {
+        if (name == m_ProcedureName) {
+            ReportError("recursive call of '" + name + "' is not allowed.");
+        } else {
+            ReportError("'" + name + "' is not a procedure.");
+        }
+        return;
+    }
+    const Procedure &procedure = m_Procedures[it->second];
+    if (count != procedure.parameters.size()) {
+        ReportError("procedure '" + name + "' takes " +
+                    std::to_string(procedure.parameters.size()) +
+                    " argument(s).");
+        return;
+    }
+
+    for (size_t i = count; i > 0; --i) {
+        m_Codegen.emit(STORE, procedure.parameters[i - 1]);
+    }
+    if (ShouldInline(procedure)) {
+        m_Codegen.emitCode(procedure.code, procedure.lines);
+        if (m_Stats) {
+            ++m_Stats->inlinedCalls;
+        }
+    } else {
+        m_Codegen.emit(CALL, it->second);
+        if (m_Stats) {
+            ++m_Stats->calls;
+        }
+    }
+}
+
+void Parser::BuiltinCall(const Builtin &builtin) {
+    // The VM takes all the arguments from the stack, so they are simply
+    // evaluated in order. The ranges are checked by the VM against the data
+    // memory, not against the declared sizes of the arrays.
+    int count = builtin.ranges + builtin.values;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) {
+            MustBe(Token::Comma);
+        }
+        if (i < builtin.ranges) {
+            RangeAddress();
+        } else {
+            Expression();
+        }
+    }
+    MustBe(Token::RightParen);
+    m_Codegen.emit(builtin.instruction);
+}
+
+void Parser::RangeAddress() {
+    if (!See(Token::Identifier)) {
+        ReportError("array name expected.");
+        return;
+    }
+    int arrayAddress = FindArray(m_Scanner.GetStringValue());
+    Next();
+    if (Match(Token::LeftBracket)) {
+        Expression();
+        MustBe(Token::RightBracket);
+        m_Codegen.emit(PUSH, arrayAddress);
+        m_Codegen.emit(ADD);
+    } else {
+        m_Codegen.emit(PUSH, arrayAddress);
+    }
+}
+
+const Builtin *Parser::FindBuiltin(const std::string &name) {
+    for (const Builtin &builtin : s_Builtins) {
+        if (name == builtin.name) {
+            return &builtin;
+        }
+    }
+    return nullptr;
+}
+
+bool Parser::ShouldInline(const Procedure &procedure) const {
+    // The largest bodies (in instructions) copied in place of a call outside
+    // of loops, in a loop and in nested loops. Outside of loops a call runs
+    // once, so only the bodies not much larger than the call itself are
+    // copied. In loops CALL and RET would be executed at every iteration, so
+    // larger bodies pay for the growth of the code.
+    static const size_t s_InlineLimits[] = {8, 32, 128};
+
+    int depth = std::min(m_LoopDepth, 2);
+    return procedure.code.size() <= s_InlineLimits[depth];
+}
+
+void Parser::PlaceProcedures() {
+    if (m_Procedures.empty()) {
+        return;
+    }
+
+    // The procedures are placed in the order of their first call. The scan
+    // goes on through the placed bodies, since they may call other
+    // procedures.
+    std::vector<int> addresses(m_Procedures.size(), -1);
+    for (int address = 0; address < m_Codegen.getCurrentAddress();
+         ++address) {
+        Command command = m_Codegen.getCommand(address);
+        if (command.instruction == CALL && addresses[command.argument] < 0) {
+            const Procedure &procedure = m_Procedures[command.argument];
+            addresses[command.argument] = m_Codegen.getCurrentAddress();
+            m_Codegen.emitCode(procedure.code, procedure.lines);
+            m_Codegen.setLine(procedure.endLine);
+            m_Codegen.emit(RET);
+        }
+    }
+
+    for (int address = 0; address < m_Codegen.getCurrentAddress();
+         ++address) {
+        const Command &command = m_Codegen.getCommand(address);
+        if (command.instruction == CALL) {
+            m_Codegen.emitAt(address, CALL, addresses[command.argument]);
+        }
+    }
+}
+
+void Parser::ParallelFor(int line) {
+    // PARALLEL FOR i := a TO b STEP c REDUCE(+: s, t) DO ... OD
+    //
+    // The VM splits the iterations among its threads and runs them in any
+    // order, so they must not depend on each other. Every thread has its
+    // own private words with negative addresses: -1 is the counter, then
+    // come the partial sums of the reduction variables and the variables
+    // first used in the body. The other variables are shared and may only
+    // be read, the arrays are shared. After the loop the partial sums are
+    // added to the reduction variables.
+    //
+    //         <a> <b> PUSH c PARALLEL n REDUCE s REDUCE t JUMP exit
+    //   body: ...
+    //         LOOP body
+    //   exit:
+    if (m_Parallel) {
+        ReportError("PARALLEL FOR cannot be nested.");
+    }
+
+    std::string counter;
+    if (See(Token::Identifier)) {
+        counter = m_Scanner.GetStringValue();
+        Next();
+    } else {
+        ReportError("loop variable expected.");
+    }
+    MustBe(Token::Assign);
+    Expression();
+    if (SeeWord("to")) {
+        Next();
+    } else {
+        ReportError("'TO' expected.");
+    }
+    Expression();
+    m_Codegen.emit(PUSH, LoopStep());
+
+    // Only the sums are supported: they do not depend on the order in
+    // which the threads finish.
+    std::vector<std::string> reductions;
+    if (SeeWord("reduce")) {
+        Next();
+        MustBe(Token::LeftParen);
+        if (See(Token::AddOp) || See(Token::MulOp)) {
+            if (!See(Token::AddOp) ||
+                m_Scanner.GetArithmeticValue() != Arithmetic::Plus) {
+                ReportError("only '+' reductions are supported.");
+            }
+            Next();
+        } else {
+            ReportError("'+' expected.");
+        }
+        MustBe(Token::Colon);
+        do {
+            if (!See(Token::Identifier)) {
+                ReportError("reduction variable expected.");
+                break;
+            }
+            std::string name = m_Scanner.GetStringValue();
+            Next();
+            if (name == counter) {
+                ReportError("loop variable '" + name +
+                            "' cannot be reduced.");
+            } else if (std::find(reductions.begin(), reductions.end(),
+                                 name) != reductions.end()) {
+                ReportError("duplicate reduction variable '" + name + "'.");
+            } else {
+                reductions.push_back(name);
+            }
+        } while (Match(Token::Comma));
+        MustBe(Token::RightParen);
+    }
+
+    int parallelAddress = m_Codegen.reserve();
+    for (const std::string &name : reductions) {
+        m_Codegen.emit(REDUCE, AssignedVariable(name));
+    }
+    int jumpAddress = m_Codegen.reserve();
+
+    VarTable outerPrivate = std::move(m_Private);
+    bool outerParallel = m_Parallel;
+    m_Private.clear();
+    m_Parallel = true;
+    PrivateVariable(counter);
+    for (const std::string &name : reductions) {
+        PrivateVariable(name);
+    }
+
+    MustBe(Token::Do);
+    int bodyAddress = m_Codegen.getCurrentAddress();
+    ++m_LoopDepth;
+    StatementList();
+    --m_LoopDepth;
+    MustBe(Token::Od);
+
+    int privateCount = static_cast<int>(m_Private.size());
+    m_Private = std::move(outerPrivate);
+    m_Parallel = outerParallel;
+
+    m_Codegen.setLine(line);
+    m_Codegen.emitAt(parallelAddress, PARALLEL, privateCount);
+    m_Codegen.emitAt(jumpAddress, JUMP, m_Codegen.getCurrentAddress() + 1);
+    m_Codegen.emit(LOOP, bodyAddress);
+}
+
+Word Parser::LoopStep() {
+    Word step = 1;
+    if (SeeWord("step")) {
+        Next();
+        if (!ConstantExpression(step)) {
+            ReportError("constant loop step expected.");
+            step = 1;
+        } else if (step == 0) {
+            ReportError("loop step must not be zero.");
+        }
+    }
+    return step;
+}
+
+bool Parser::ReadsVariable(int start, int address) {
+    for (int i = start; i < m_Codegen.getCurrentAddress(); ++i) {
+        const Command &command = m_Codegen.getCommand(i);
+        if ((command.instruction == LOAD || command.instruction == ADDM) &&
+            command.argument == address) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Parser::ConstantExpression(Word &value) {
+    int start = m_Codegen.getCurrentAddress();
+    Expression();
+    std::vector<Command> code;
+    std::vector<int> lines;
+    m_Codegen.cut(start, code, lines);
+    switch (Evaluate(code, value)) {
+    case ConstantValue::Known:
+        return true;
+    case ConstantValue::Unknown:
+        return false;
+    case ConstantValue::OutOfRange:
+        ReportError("constant is out of range.");
+        break;
+    case ConstantValue::DivisionByZero:
+        ReportError("division by zero in constant expression.");
+        break;
+    }
+    // The error is reported; the value only lets the parsing go on.
+    value = 1;
+    return true;
 }
 
 void Parser::StatementList() {
     // If the list of operators is empty, the next token will be one of the
-    // possible "closing brackets": END, OD, ELSE, FI. In this case, the result
+    // possible "closing brackets": END, OD, ELSE, FI, '|', ESAC. In this case,
+    // the result
     // of parsing will be an empty block (its list of operators is null). If
     // the next token is not included in this list, then we consider it the
     // beginning of the operator and we call the statement method. The sign of
     // the last operator is the absence of a semicolon after the operator.
     if (See(Token::End) || See(Token::Od) || See(Token::Else) ||
-        See(Token::Fi)) {
+        See(Token::Fi) || See(Token::Bar) || See(Token::Esac)) {
         return;
     } else {
         bool more = true;
@@ -65,28 +568,102 @@ void Parser::StatementList() {
 }
 
 void Parser::Statement() {
-    if (See(Token::Identifier)) {
-        // If we meet a variable, then we remember its address or add a new one
-        // if we haven't met it. The next token should be assignment. Then
-        // comes the expression block, which returns the value to the top of
-        // the stack. We write this value to the address of our variable.
+    if (m_Stats) {
+        ++m_Stats->statements;
+    }
 
-        int varAddress = FindOrAddVariable(m_Scanner.GetStringValue());
+    // The code of the statement is attributed to the line where it starts;
+    // nested statements change the line, so it is restored after them.
+    int line = m_Scanner.GetLineNumber();
+    m_Codegen.setLine(line);
+
+    if (See(Token::Identifier)) {
+        std::string name = m_Scanner.GetStringValue();
         Next();
-        MustBe(Token::Assign);
-        Expression();
-        m_Codegen.emit(STORE, varAddress);
+        if (name == "parallel" && Match(Token::For)) {
+            // PARALLEL is not a reserved word either: it starts a statement
+            // only when FOR follows it.
+            ParallelFor(line);
+        } else if (Match(Token::LeftParen)) {
+            const Builtin *builtin = FindBuiltin(name);
+            if (!builtin) {
+                Call(name);
+            } else if (builtin->function) {
+                ReportError("'" + name + "' returns a value and cannot be "
+                            "called as a statement.");
+                Recover(Token::RightParen);
+            } else {
+                BuiltinCall(*builtin);
+            }
+        } else if (Match(Token::LeftBracket)) {
+            // Assignment to an array element. BSTORE takes the index from
+            // the top of the stack and the value from under it, so the code
+            // of the value is moved before the code of the index (the value
+            // is evaluated first).
+            int arrayAddress = FindArray(name);
+            int indexAddress = m_Codegen.getCurrentAddress();
+            Expression();
+            MustBe(Token::RightBracket);
+            MustBe(Token::Assign);
+            int valueAddress = m_Codegen.getCurrentAddress();
+            Expression();
+            m_Codegen.moveBefore(indexAddress, valueAddress);
+            m_Codegen.emit(BSTORE, arrayAddress);
+        } else {
+            // If we meet a variable, then we remember its address or add a
+            // new one if we haven't met it. The next token should be
+            // assignment. Then comes the expression block, which returns the
+            // value to the top of the stack. We write this value to the
+            // address of our variable.
+            int varAddress = AssignedVariable(name);
+            MustBe(Token::Assign);
+            Expression();
+            m_Codegen.emit(STORE, varAddress);
+        }
+    } else if (Match(Token::Array)) {
+        // ARRAY a[n] allocates n consecutive words, no code is generated.
+        if (See(Token::Identifier)) {
+            std::string name = m_Scanner.GetStringValue();
+            Next();
+            MustBe(Token::LeftBracket);
+            Word size = 0;
+            if (!ConstantExpression(size)) {
+                ReportError("constant array size expected.");
+            }
+            MustBe(Token::RightBracket);
+            AddArray(name, size);
+        } else {
+            ReportError("array name expected.");
+        }
+    } else if (Match(Token::Const)) {
+        // CONST n = e names the value of a constant expression. The uses of
+        // the name compile to PUSH, no code is generated here.
+        if (See(Token::Identifier)) {
+            std::string name = m_Scanner.GetStringValue();
+            Next();
+            if (See(Token::Cmp) &&
+                m_Scanner.GetCmpValue() == Comparison::Equal) {
+                Next();
+            } else {
+                ReportError("'=' expected.");
+            }
+            Word value = 0;
+            if (ConstantExpression(value)) {
+                AddConstant(name, value);
+            } else {
+                ReportError("value of constant '" + name +
+                            "' is not known at compile time.");
+            }
+        } else {
+            ReportError("constant name expected.");
+        }
     } else if (Match(Token::If)) {
-        // If an IF is encountered, then the condition must follow. There is a
-        // 1 or 0 at the top of the stack, depending on the condition being
-        // met. Then reserve a place for the conditional JUMP_NO transition to
-        // the ELSE block (transition in case of a false condition). The
-        // transition address will become known only after the code for the
-        // THEN block is generated.
-
-        Relation();
+        // If an IF is encountered, then the condition must follow. Its code
+        // falls through to the THEN block when the condition is met, and the
+        // jumps taken when it fails go to the ELSE block. Their address will
+        // become known only after the code for the THEN block is generated.
 
-        int jumpNoAddress = m_Codegen.reserve();
+        JumpList falseJumps = Condition();
 
         MustBe(Token::Then);
         StatementList();
@@ -94,12 +671,12 @@ void Parser::Statement() {
             // If there is an ELSE block, then in order not to execute it if
             // THEN is executed, we reserve a place for the JUMP command at the
             // end of this block.
+            m_Codegen.setLine(line);
             int jumpAddress = m_Codegen.reserve();
 
-            // Fill in the reserved space after checking the condition with the
-            // instruction to go to the beginning of the ELSE block.
-            m_Codegen.emitAt(jumpNoAddress, JUMP_NO,
-                             m_Codegen.getCurrentAddress());
+            // Fill in the reserved jumps of the condition with the address of
+            // the beginning of the ELSE block.
+            SetJumps(falseJumps, m_Codegen.getCurrentAddress());
 
             StatementList();
 
@@ -107,44 +684,335 @@ void Parser::Statement() {
             // end of the conditional ELSE block.
             m_Codegen.emitAt(jumpAddress, JUMP, m_Codegen.getCurrentAddress());
         } else {
-            // If there is no ELSE block, then after checking the condition,
-            // the following information will be written to the reserved
-            // address conditional jump instruction to the end of the IF...THEN
-            // statement
-            m_Codegen.emitAt(jumpNoAddress, JUMP_NO,
-                             m_Codegen.getCurrentAddress());
+            // If there is no ELSE block, then the jumps of the condition go to
+            // the end of the IF...THEN statement.
+            SetJumps(falseJumps, m_Codegen.getCurrentAddress());
         }
         MustBe(Token::Fi);
     } else if (Match(Token::While)) {
         // Save the address of the start of the condition check.
         int conditionAddress = m_Codegen.getCurrentAddress();
 
-        Relation();
-
-        // Reserve a place for the conditional jump instruction to exit loop.
-        int jumpNoAddress = m_Codegen.reserve();
+        // The jumps taken when the condition fails exit the loop.
+        JumpList falseJumps = Condition();
 
         MustBe(Token::Do);
+        ++m_LoopDepth;
         StatementList();
+        --m_LoopDepth;
         MustBe(Token::Od);
 
         // Jump to the address of the loop condition.
+        m_Codegen.setLine(line);
         m_Codegen.emit(JUMP, conditionAddress);
 
-        // Fill in the reserved address with the conditional jump instruction
-        // to the operator following the loop.
-        m_Codegen.emitAt(jumpNoAddress, JUMP_NO,
-                         m_Codegen.getCurrentAddress());
+        // Fill in the reserved jumps with the address of the operator
+        // following the loop.
+        SetJumps(falseJumps, m_Codegen.getCurrentAddress());
+    } else if (Match(Token::For)) {
+        // FOR i := a TO b STEP c DO ... OD
+        //
+        // The limit and the step stay on the stack under the address of the
+        // counter while the loop runs, so the limit is evaluated only once.
+        // The counter starts one step before a, and LOOP after the body adds
+        // the step, compares and jumps back in one instruction:
+        //
+        //         <a> PUSH c SUB STORE i <b> PUSH c PUSH i JUMP loop
+        //   body: ...
+        //   loop: LOOP body
+        //
+        // The step must be a constant, its sign selects the comparison.
+        // TO and STEP are not reserved words, so they may still be used as
+        // variable names.
+        //
+        // The limit must see the counter as it was before the loop, so if
+        // <b> reads it, a - c is kept in a word of its own until <b> is
+        // evaluated:
+        //
+        //         <a> PUSH c SUB STORE t <b> LOAD t STORE i PUSH c ...
+        std::string name;
+        int counterAddress = 0;
+        if (See(Token::Identifier)) {
+            // The counters of the loops in a PARALLEL FOR are private.
+            name = m_Scanner.GetStringValue();
+            counterAddress = m_Parallel ? PrivateVariable(name)
+                                        : FindOrAddVariable(name);
+            Next();
+        } else {
+            ReportError("loop variable expected.");
+        }
+        MustBe(Token::Assign);
+        Expression();
+        int pushStepAddress = m_Codegen.reserve();
+        int subAddress = m_Codegen.reserve();
+        int storeAddress = m_Codegen.reserve();
+
+        if (SeeWord("to")) {
+            Next();
+        } else {
+            ReportError("'TO' expected.");
+        }
+        int limitAddress = m_Codegen.getCurrentAddress();
+        Expression();
+        Word step = LoopStep();
+
+        m_Codegen.emitAt(pushStepAddress, PUSH, step);
+        m_Codegen.emitAt(subAddress, SUB);
+        if (ReadsVariable(limitAddress, counterAddress)) {
+            // '$' cannot start an identifier, so the name of the word
+            // does not clash with the variables of the program.
+            std::string start = "$" + name;
+            int startAddress = m_Parallel ? PrivateVariable(start)
+                                          : FindOrAddVariable(start);
+            m_Codegen.emitAt(storeAddress, STORE, startAddress);
+            m_Codegen.emit(LOAD, startAddress);
+            m_Codegen.emit(STORE, counterAddress);
+        } else {
+            m_Codegen.emitAt(storeAddress, STORE, counterAddress);
+        }
+        m_Codegen.emit(PUSH, step);
+        m_Codegen.emit(PUSH, counterAddress);
+        int jumpAddress = m_Codegen.reserve();
+
+        MustBe(Token::Do);
+        int bodyAddress = m_Codegen.getCurrentAddress();
+        ++m_LoopDepth;
+        StatementList();
+        --m_LoopDepth;
+        MustBe(Token::Od);
+
+        m_Codegen.setLine(line);
+        m_Codegen.emitAt(jumpAddress, JUMP, m_Codegen.getCurrentAddress());
+        m_Codegen.emit(LOOP, bodyAddress);
+    } else if (Match(Token::Case)) {
+        // CASE e OF 1, 2: ... | 5: ... ELSE ... ESAC
+        //
+        // The labels are known only after the arms are compiled, so the
+        // dispatch code is generated after them and then moved before them:
+        //
+        //         <e> <dispatch>
+        //   arm1: ... JUMP end
+        //   arm2: ... JUMP end
+        //   else: ...
+        //   end:
+        //
+        // Dense labels are dispatched with JUMP_TABLE, sparse ones with a
+        // binary search.
+        Expression();
+        MustBe(Token::Of);
+        int armsAddress = m_Codegen.getCurrentAddress();
+
+        CaseLabels labels;
+        std::vector<int> exitJumps;
+        do {
+            int armAddress = m_Codegen.getCurrentAddress();
+            do {
+                Word value;
+                if (!ConstantExpression(value)) {
+                    ReportError("constant CASE label expected.");
+                    break;
+                }
+                if (!labels.emplace(value, armAddress).second) {
+                    ReportError("duplicate CASE label " +
+                                std::to_string(value) + ".");
+                }
+            } while (Match(Token::Comma));
+            MustBe(Token::Colon);
+
+            StatementList();
+            if (See(Token::Bar) || See(Token::Else)) {
+                m_Codegen.setLine(line);
+                exitJumps.push_back(m_Codegen.reserve());
+            }
+        } while (Match(Token::Bar));
+
+        int defaultAddress = -1;
+        if (Match(Token::Else)) {
+            defaultAddress = m_Codegen.getCurrentAddress();
+            StatementList();
+        }
+        MustBe(Token::Esac);
+
+        m_Codegen.setLine(line);
+        int dispatchAddress = m_Codegen.getCurrentAddress();
+        JumpList defaultJumps;
+        CaseDispatch(labels, defaultJumps);
+        int dispatchSize = m_Codegen.getCurrentAddress() - dispatchAddress;
+        SetJumps(defaultJumps, defaultAddress < 0
+                                   ? m_Codegen.getCurrentAddress()
+                                   : defaultAddress);
+        m_Codegen.moveBefore(armsAddress, dispatchAddress);
+
+        for (int jump : exitJumps) {
+            m_Codegen.emitAt(jump + dispatchSize, JUMP,
+                             m_Codegen.getCurrentAddress());
+        }
+    } else if (Match(Token::Read)) {
+        // READ(a, n) reads n words into the array a or into a[i] and the
+        // elements after it, READ(x, y, z) reads the variables. Variables at
+        // consecutive addresses are read by one instruction.
+        if (m_Parallel) {
+            ReportError("input is not allowed in PARALLEL FOR.");
+        }
+        MustBe(Token::LeftParen);
+        if (SeeArray()) {
+            RangeAddress();
+            MustBe(Token::Comma);
+            Expression();
+            m_Codegen.emit(INPUT_BLOCK);
+        } else {
+            std::vector<int> addresses;
+            do {
+                if (!See(Token::Identifier)) {
+                    ReportError("variable name expected.");
+                    break;
+                }
+                addresses.push_back(
+                    AssignedVariable(m_Scanner.GetStringValue()));
+                Next();
+            } while (Match(Token::Comma));
+
+            for (size_t first = 0; first < addresses.size();) {
+                size_t last = first + 1;
+                while (last < addresses.size() &&
+                       addresses[last] == addresses[last - 1] + 1) {
+                    ++last;
+                }
+                if (last - first == 1) {
+                    m_Codegen.emit(INPUT);
+                    m_Codegen.emit(STORE, addresses[first]);
+                } else {
+                    m_Codegen.emit(PUSH, addresses[first]);
+                    m_Codegen.emit(PUSH, static_cast<Word>(last - first));
+                    m_Codegen.emit(INPUT_BLOCK);
+                }
+                first = last;
+            }
+        }
+        MustBe(Token::RightParen);
     } else if (Match(Token::Write)) {
+        // WRITE(e1, e2, ...) prints the values, WRITE(a, n) prints n words
+        // of the array a. An array name without an index is not an
+        // expression, so the forms differ in the first argument.
+        if (m_Parallel) {
+            ReportError("output is not allowed in PARALLEL FOR.");
+        }
         MustBe(Token::LeftParen);
-        Expression();
+        bool range = false;
+        int count = 0;
+        if (SeeArray()) {
+            int arrayAddress = FindArray(m_Scanner.GetStringValue());
+            Next();
+            if (Match(Token::LeftBracket)) {
+                // The element starts the first expression.
+                Expression();
+                MustBe(Token::RightBracket);
+                m_Codegen.emit(BLOAD, arrayAddress);
+                TermTail();
+                ExpressionTail();
+                count = 1;
+            } else {
+                m_Codegen.emit(PUSH, arrayAddress);
+                MustBe(Token::Comma);
+                Expression();
+                range = true;
+            }
+        }
+        if (!range) {
+            if (count == 0) {
+                Expression();
+                count = 1;
+            }
+            while (Match(Token::Comma)) {
+                Expression();
+                ++count;
+            }
+        }
         MustBe(Token::RightParen);
-        m_Codegen.emit(PRINT);
+        if (range) {
+            m_Codegen.emit(PRINT_BLOCK);
+        } else if (count == 1) {
+            m_Codegen.emit(PRINT);
+        } else {
+            m_Codegen.emit(PRINT_STACK, count);
+        }
     } else {
         ReportError("statement expected.");
     }
 }
 
+void Parser::CaseDispatch(const CaseLabels &labels, JumpList &defaultJumps) {
+    // The largest table and the fewest labels per table entry.
+    static const Word s_MaxTableSize = 4096;
+    static const Word s_MaxEntriesPerLabel = 2;
+
+    if (labels.empty()) {
+        m_Codegen.emit(POP);
+        defaultJumps.emplace_back(m_Codegen.reserve(), JUMP);
+        return;
+    }
+
+    Word first = labels.begin()->first;
+    Word last = labels.rbegin()->first;
+    // The difference may not fit in a Word.
+    std::uint64_t range = static_cast<std::uint64_t>(last) -
+                          static_cast<std::uint64_t>(first) + 1;
+    Word count = labels.size();
+    if (range > static_cast<std::uint64_t>(s_MaxTableSize) ||
+        static_cast<Word>(range) > s_MaxEntriesPerLabel * count + 2) {
+        std::vector<std::pair<Word, int>> sorted(labels.begin(),
+                                                 labels.end());
+        CaseTree(sorted, 0, sorted.size(), defaultJumps);
+        return;
+    }
+
+    if (first != 0) {
+        m_Codegen.emit(PUSH, first);
+        m_Codegen.emit(SUB);
+    }
+    m_Codegen.emit(JUMP_TABLE, range);
+    for (Word value = first; value <= last; ++value) {
+        CaseLabels::const_iterator it = labels.find(value);
+        if (it != labels.end()) {
+            m_Codegen.emit(JUMP, it->second);
+        } else {
+            defaultJumps.emplace_back(m_Codegen.reserve(), JUMP);
+        }
+    }
+    defaultJumps.emplace_back(m_Codegen.reserve(), JUMP);
+}
+
+void Parser::CaseTree(const std::vector<std::pair<Word, int>> &labels,
+                      size_t first, size_t last, JumpList &defaultJumps) {
+    // The value stays on the stack until one of the labels matches it.
+    static const size_t s_MaxLinearLabels = 3;
+
+    if (last - first <= s_MaxLinearLabels) {
+        for (size_t i = first; i < last; ++i) {
+            m_Codegen.emit(DUP);
+            m_Codegen.emit(PUSH, labels[i].first);
+            m_Codegen.emit(COMPARE, 1);
+            int nextAddress = m_Codegen.reserve();
+            m_Codegen.emit(POP);
+            m_Codegen.emit(JUMP, labels[i].second);
+            m_Codegen.emitAt(nextAddress, JUMP_YES,
+                             m_Codegen.getCurrentAddress());
+        }
+        m_Codegen.emit(POP);
+        defaultJumps.emplace_back(m_Codegen.reserve(), JUMP);
+        return;
+    }
+
+    size_t middle = first + (last - first) / 2;
+    m_Codegen.emit(DUP);
+    m_Codegen.emit(PUSH, labels[middle].first);
+    m_Codegen.emit(COMPARE, 2);
+    int lessAddress = m_Codegen.reserve();
+    CaseTree(labels, middle, last, defaultJumps);
+    m_Codegen.emitAt(lessAddress, JUMP_YES, m_Codegen.getCurrentAddress());
+    CaseTree(labels, first, middle, defaultJumps);
+}
+
 /*
  * An arithmetic expression is described by the following rules:
  * 	<expression> -> <term> | <term> + <term> | <term> - <term>
@@ -156,6 +1024,10 @@ void Parser::Statement() {
  */
 void Parser::Expression() {
     Term();
+    ExpressionTail();
+}
+
+void Parser::ExpressionTail() {
     while (See(Token::AddOp)) {
         Arithmetic op = m_Scanner.GetArithmeticValue();
         Next();
@@ -180,6 +1052,10 @@ void Parser::Expression() {
  */
 void Parser::Term() {
     Factor();
+    TermTail();
+}
+
+void Parser::TermTail() {
     while (See(Token::MulOp)) {
         Arithmetic op = m_Scanner.GetArithmeticValue();
         Next();
@@ -195,17 +1071,40 @@ void Parser::Term() {
 
 /*
  * Factor is described by the following rules:
- *  <factor> -> number | identifier | -<factor> | (<expression>) | READ
+ *  <factor> -> number | constant | identifier | identifier[<expression>] |
+ *              -<factor> | (<expression>) | READ |
+ *              VSUM(<range>, <expression>)
  */
 void Parser::Factor() {
     if (See(Token::Number)) {
-        int value = m_Scanner.GetIntValue();
+        Word value = m_Scanner.GetIntValue();
+        if (m_Scanner.IsIntOverflow()) {
+            ReportError("number is too large.");
+        }
         Next();
         m_Codegen.emit(PUSH, value);
     } else if (See(Token::Identifier)) {
-        int varAddress = FindOrAddVariable(m_Scanner.GetStringValue());
+        std::string name = m_Scanner.GetStringValue();
         Next();
-        m_Codegen.emit(LOAD, varAddress);
+        if (Match(Token::LeftBracket)) {
+            int arrayAddress = FindArray(name);
+            Expression();
+            MustBe(Token::RightBracket);
+            m_Codegen.emit(BLOAD, arrayAddress);
+        } else if (Match(Token::LeftParen)) {
+            const Builtin *builtin = FindBuiltin(name);
+            if (builtin && builtin->function) {
+                BuiltinCall(*builtin);
+            } else {
+                ReportError("'" + name + "' does not return a value.");
+                Recover(Token::RightParen);
+            }
+        } else if (m_Symbols.constants.count(name) &&
+                   !m_Parameters.count(name)) {
+            m_Codegen.emit(PUSH, m_Symbols.constants[name]);
+        } else {
+            m_Codegen.emit(LOAD, FindOrAddVariable(name));
+        }
     } else if (See(Token::AddOp) &&
                m_Scanner.GetArithmeticValue() == Arithmetic::Minus) {
         Next();
@@ -215,17 +1114,111 @@ void Parser::Factor() {
         Expression();
         MustBe(Token::RightParen);
     } else if (Match(Token::Read)) {
+        if (m_Parallel) {
+            ReportError("input is not allowed in PARALLEL FOR.");
+        }
         m_Codegen.emit(INPUT);
     } else {
         ReportError("expression expected.");
     }
 }
 
-// The condition compares two expressions.
-// Depending on the result of the comparison
-// at the top of the stack it will be 0 or 1.
-void Parser::Relation() {
-    Expression();
+/*
+ * Conditions are described by the following rules:
+ *  <condition>   -> <conjunction> | <conjunction> OR <conjunction> ...
+ *  <conjunction> -> <negation> | <negation> AND <negation> ...
+ *  <negation>    -> NOT <negation> | (<condition>) |
+ *                   <expression> <comparison> <expression>
+ *
+ * A parenthesis may also start the first expression of a comparison, as in
+ * (a + b) * c < d. Since it is not known which of the two it is until the
+ * closing parenthesis, the contents are parsed as a condition that may turn
+ * out to be an expression, and then the comparison goes on.
+ */
+Parser::JumpList Parser::Condition() {
+    Branches branches;
+    Disjunction(branches, false);
+    ContinueOnTrue(branches);
+    SetJumps(branches.onTrue, m_Codegen.getCurrentAddress());
+    return branches.onFalse;
+}
+
+bool Parser::Disjunction(Branches &branches, bool mayBeExpression) {
+    if (!Conjunction(branches, mayBeExpression)) {
+        return false;
+    }
+    while (Match(Token::Or)) {
+        // If the left operand holds, the whole condition does; otherwise the
+        // right operand decides.
+        ContinueOnFalse(branches);
+        SetJumps(branches.onFalse, m_Codegen.getCurrentAddress());
+
+        Branches right;
+        Conjunction(right, false);
+        branches.onTrue.insert(branches.onTrue.end(), right.onTrue.begin(),
+                               right.onTrue.end());
+        branches.onFalse = std::move(right.onFalse);
+        branches.last = right.last;
+        branches.inverted = right.inverted;
+    }
+    return true;
+}
+
+bool Parser::Conjunction(Branches &branches, bool mayBeExpression) {
+    if (!Negation(branches, mayBeExpression)) {
+        return false;
+    }
+    while (Match(Token::And)) {
+        // If the left operand fails, the whole condition does; otherwise the
+        // right operand decides.
+        ContinueOnTrue(branches);
+        SetJumps(branches.onTrue, m_Codegen.getCurrentAddress());
+
+        Branches right;
+        Negation(right, false);
+        branches.onFalse.insert(branches.onFalse.end(),
+                                right.onFalse.begin(), right.onFalse.end());
+        branches.onTrue = std::move(right.onTrue);
+        branches.last = right.last;
+        branches.inverted = right.inverted;
+    }
+    return true;
+}
+
+bool Parser::Negation(Branches &branches, bool mayBeExpression) {
+    if (Match(Token::Not)) {
+        // Only the meaning of the jumps changes.
+        Negation(branches, false);
+        std::swap(branches.onTrue, branches.onFalse);
+        branches.inverted = !branches.inverted;
+        return true;
+    }
+
+    if (Match(Token::LeftParen)) {
+        bool isCondition = Disjunction(branches, true);
+        MustBe(Token::RightParen);
+        if (isCondition) {
+            return true;
+        }
+        // The expression in parentheses is the first factor of the
+        // comparison.
+        TermTail();
+        ExpressionTail();
+    } else {
+        Expression();
+    }
+
+    if (mayBeExpression && See(Token::RightParen)) {
+        return false;
+    }
+    Relation(branches);
+    return true;
+}
+
+// Compare the expression on the stack with the next one. There will be 0 or
+// 1 at the top of the stack depending on the result of the comparison, and a
+// place is reserved for the conditional jump.
+void Parser::Relation(Branches &branches) {
     if (See(Token::Cmp)) {
         Comparison cmp = m_Scanner.GetCmpValue();
         Next();
@@ -253,18 +1246,136 @@ void Parser::Relation() {
     } else {
         ReportError("comparison operator expected.");
     }
+    branches.last = m_Codegen.reserve();
+    branches.inverted = false;
+}
+
+void Parser::ContinueOnTrue(Branches &branches) {
+    branches.onFalse.emplace_back(branches.last,
+                                  branches.inverted ? JUMP_YES : JUMP_NO);
+}
+
+void Parser::ContinueOnFalse(Branches &branches) {
+    branches.onTrue.emplace_back(branches.last,
+                                 branches.inverted ? JUMP_NO : JUMP_YES);
+}
+
+void Parser::SetJumps(const JumpList &jumps, int address) {
+    for (const std::pair<int, Instruction> &jump : jumps) {
+        m_Codegen.emitAt(jump.first, jump.second, address);
+    }
 }
 
 int Parser::FindOrAddVariable(const std::string &var) {
-    VarTable::iterator it = m_Variables.find(var);
-    if (it == m_Variables.end()) {
-        m_Variables[var] = m_LastVariable;
-        return m_LastVariable++;
+    // In a PARALLEL FOR the private words hide the other variables, and the
+    // names not used before the loop become private.
+    if (m_Parallel) {
+        VarTable::const_iterator word = m_Private.find(var);
+        if (word != m_Private.end()) {
+            return word->second;
+        }
+        if (!m_Parameters.count(var) && !m_Symbols.variables.count(var)) {
+            return PrivateVariable(var);
+        }
+    }
+
+    if (m_Symbols.constants.count(var) && !m_Parameters.count(var)) {
+        ReportError("'" + var + "' is a constant.");
+    }
+
+    if (m_References && std::find(m_References->begin(), m_References->end(),
+                                  var) == m_References->end()) {
+        m_References->push_back(var);
+    }
+
+    VarTable::const_iterator parameter = m_Parameters.find(var);
+    if (parameter != m_Parameters.end()) {
+        return parameter->second;
+    }
+
+    VarTable &variables = m_Symbols.variables;
+    VarTable::iterator it = variables.find(var);
+    if (it == variables.end()) {
+        variables[var] = m_Symbols.lastVariable;
+        return m_Symbols.lastVariable++;
     } else {
+        if (m_Symbols.arrays.count(var)) {
+            ReportError("'" + var + "' is an array, index expected.");
+        }
         return it->second;
     }
 }
 
+int Parser::AssignedVariable(const std::string &name) {
+    int address = FindOrAddVariable(name);
+    if (m_Parallel && address >= 0) {
+        ReportError("shared variable '" + name +
+                    "' cannot be assigned in PARALLEL FOR.");
+    }
+    return address;
+}
+
+int Parser::PrivateVariable(const std::string &name) {
+    VarTable::const_iterator word = m_Private.find(name);
+    if (word != m_Private.end()) {
+        return word->second;
+    }
+    if (m_Symbols.constants.count(name)) {
+        ReportError("'" + name + "' is a constant.");
+    }
+    int address = -static_cast<int>(m_Private.size()) - 1;
+    m_Private[name] = address;
+    return address;
+}
+
+bool Parser::SeeArray() {
+    if (!See(Token::Identifier)) {
+        return false;
+    }
+    const std::string &name = m_Scanner.GetStringValue();
+    return m_Symbols.arrays.count(name) && !m_Parameters.count(name) &&
+           !m_Private.count(name);
+}
+
+int Parser::FindArray(const std::string &name) {
+    if (m_References && std::find(m_References->begin(), m_References->end(),
+                                  name) == m_References->end()) {
+        m_References->push_back(name);
+    }
+
+    if (m_Parameters.count(name) || !m_Symbols.arrays.count(name)) {
+        ReportError("'" + name + "' is not an array.");
+        return 0;
+    }
+    return m_Symbols.variables[name];
+}
+
+void Parser::AddArray(const std::string &name, Word size) {
+    // The data segment of the virtual machine holds at most 2^24 words.
+    static const Word s_MaxArraySize = 1 << 24;
+
+    if (m_Parallel) {
+        ReportError("arrays cannot be declared in PARALLEL FOR.");
+    } else if (m_Symbols.variables.count(name) || m_Parameters.count(name)) {
+        ReportError("'" + name + "' is already declared.");
+    } else if (size <= 0 || size > s_MaxArraySize) {
+        ReportError("invalid size of array '" + name + "'.");
+    } else {
+        m_Symbols.variables[name] = m_Symbols.lastVariable;
+        m_Symbols.arrays[name] = size;
+        m_Symbols.lastVariable += size;
+    }
+}
+
+void Parser::AddConstant(const std::string &name, Word value) {
+    if (m_Symbols.variables.count(name) || m_Symbols.constants.count(name) ||
+        m_Parameters.count(name) || m_Private.count(name)) {
+        ReportError("'" + name + "' is already declared.");
+    } else {
+        m_Symbols.constants[name] = value;
+    }
+}
+
 void Parser::MustBe(Token t) {
     if (!Match(t)) {
         m_IsError = true;
@@ -279,6 +1390,10 @@ void Parser::MustBe(Token t) {
 }
 
 void Parser::Recover(Token t) {
+    if (m_Stats) {
+        ++m_Stats->recoveries;
+    }
+
     while (!See(t) && !See(Token::Eof)) {
         Next();
     }
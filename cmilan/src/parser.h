@@ -1,6 +1,10 @@
 #ifndef CMILAN_PARSER_H
 #define CMILAN_PARSER_H
 
+#include <memory>
+#include <ostream>
+#include <vector>
+
 #include "codegen.h"
 #include "scanner.h"
 
@@ -26,25 +30,177 @@
  * found during the parsing process, the code for the VM is not printed.
  * */
 
+// Variables of the program being compiled.
+struct SymbolTable {
+    // Addresses of the variables and of the first elements of the arrays.
+    std::map<std::string, int> variables;
+    // Sizes of the arrays.
+    std::map<std::string, int> arrays;
+    // Values of the constants declared by CONST; they take no data words.
+    std::map<std::string, Word> constants;
+    // the number of the last recorded variable
+    int lastVariable = 0;
+};
+
+// A procedure compiled before the main program. Its code is kept apart from
+// the program: every call either copies it or calls the single copy placed
+// after the main program.
+struct Procedure {
+    // Addresses of the parameters.
+    std::vector<int> parameters;
+    // The body without RET, code addresses start at 0, and the source lines
+    // of its instructions.
+    std::vector<Command> code;
+    std::vector<int> lines;
+    // Line of the END of the procedure (RET is attributed to it).
+    int endLine = 0;
+};
+
+// A built-in operation on ranges of array words. The names of the built-ins
+// are not reserved: a name is taken for a built-in when it is followed by a
+// parenthesis.
+struct Builtin {
+    const char *name;
+    Instruction instruction;
+    // Number of the ranges, whose addresses are the first arguments, and of
+    // the values that follow them.
+    int ranges;
+    int values;
+    // The built-in leaves a value on the stack and is called in expressions.
+    bool function;
+};
+
 class Parser {
 public:
     // The constructor creates instances of the lexical analyzer and code
-    // generator.
-    Parser(const std::string &fileName, std::istream &input);
+    // generator. The generated code is written to output, error messages are
+    // written to errors.
+    // If stats is not null, the counters of all the phases are added to it.
+    Parser(const std::string &fileName, std::istream &input,
+           OutputSink &output, std::ostream &errors,
+           CompileStats *stats = nullptr);
+
+    // The constructor for parsing a part of the program: the code is appended
+    // to the existing code generator and the variables are taken from the
+    // existing table. The input starts at the specified line of the file.
+    Parser(const std::string &fileName, std::istream &input, int lineNumber,
+           std::ostream &errors, CodeGen &codegen, SymbolTable &symbols,
+           CompileStats *stats = nullptr);
 
-    void Parse();
+    // Parse the program and print the code if no errors were found.
+    // Returns true on success.
+    bool Parse();
+
+    // Output the map from the code addresses to the source lines.
+    void PrintLineMap(OutputSink &output) const;
+
+    // Parse the input as a single statement. The names of the variables used
+    // by the statement are added to references in the order of their first
+    // use. Returns true on success.
+    bool ParseStatement(std::vector<std::string> &references);
 
 private:
     using VarTable = std::map<std::string, int>;
 
     // Non-terminals
     void Program();
+    void ProcedureDeclaration();
+    void Call(const std::string &name);
+    void BuiltinCall(const Builtin &builtin);
+    // Address of a range: an array name (its first element) or an element
+    // a[i].
+    void RangeAddress();
+    void ParallelFor(int line);
     void StatementList();
     void Statement();
     void Expression();
     void Term();
     void Factor();
-    void Relation();
+
+    // The rest of a term after its first factor and the rest of an
+    // expression after its first term.
+    void TermTail();
+    void ExpressionTail();
+
+    // Conditional jumps with the instructions they are set to.
+    using JumpList = std::vector<std::pair<int, Instruction>>;
+
+    // Conditions compile to chains of conditional jumps, so AND, OR and NOT
+    // never compute boolean values. Every comparison ends with a reserved
+    // jump. The jump of the last comparison is set when it is known whether
+    // the code following the condition runs when it holds or when it fails;
+    // the other jumps are collected in the lists of the jumps taken when the
+    // condition holds and when it fails.
+    struct Branches {
+        JumpList onTrue;
+        JumpList onFalse;
+        // Reserved jump of the last comparison and whether NOT inverts it.
+        int last = -1;
+        bool inverted = false;
+    };
+
+    // Parse a condition; the code following it runs when the condition
+    // holds. Returns the jumps to set to the address of the code run when
+    // the condition fails.
+    JumpList Condition();
+
+    // Non-terminals of the conditions. If mayBeExpression is set, the input
+    // may turn out to be an arithmetic expression in parentheses: then its
+    // value is left on the stack and false is returned.
+    bool Disjunction(Branches &branches, bool mayBeExpression);
+    bool Conjunction(Branches &branches, bool mayBeExpression);
+    bool Negation(Branches &branches, bool mayBeExpression);
+    // Comparison of the expression on the stack with the next one.
+    void Relation(Branches &branches);
+
+    // Set the last jump of the condition so that the following code runs
+    // when the condition holds or when it fails.
+    void ContinueOnTrue(Branches &branches);
+    void ContinueOnFalse(Branches &branches);
+
+    // Set the jumps to the address.
+    void SetJumps(const JumpList &jumps, int address);
+
+    // Labels of a CASE statement and the addresses of their arms.
+    using CaseLabels = std::map<Word, int>;
+
+    // Generate the dispatch of a CASE statement on the value on the stack.
+    // The jumps to the ELSE arm are added to defaultJumps.
+    void CaseDispatch(const CaseLabels &labels, JumpList &defaultJumps);
+
+    // Binary search of the labels [first, last) sorted by value.
+    void CaseTree(const std::vector<std::pair<Word, int>> &labels,
+                  size_t first, size_t last, JumpList &defaultJumps);
+
+    // Parse the optional STEP of a FOR loop: a constant, 1 by default.
+    Word LoopStep();
+
+    // Check if the code emitted since the address start reads the data word
+    // at the address.
+    bool ReadsVariable(int start, int address);
+
+    // Parse an expression and store its value to value if it is known at
+    // compile time, i.e. made of numbers and constants. It is computed at the
+    // width of Word (the code generator folds only the values fitting in 32
+    // bits); a value out of the Word range is reported as an error. The code
+    // of the expression is removed. Returns false if the expression is not
+    // constant.
+    bool ConstantExpression(Word &value);
+
+    // Check if a call of the procedure in the current loop depth should copy
+    // its body instead of calling it.
+    bool ShouldInline(const Procedure &procedure) const;
+
+    // Returns the built-in with this name or null.
+    static const Builtin *FindBuiltin(const std::string &name);
+
+    // Place the procedures that are still called after the main program and
+    // replace the procedure numbers in CALL with their addresses.
+    void PlaceProcedures();
+
+    // Check if the current token is the identifier that serves as a keyword
+    // in this place (TO and STEP in the FOR statement).
+    bool SeeWord(const char *word);
 
     // Comparing the current token with the target. The current position in the
     // token stream does not change.
@@ -56,6 +212,10 @@ private:
 
     void Next();
 
+    // Parse with the non-terminal method and add the time spent (excluding
+    // the scanning) to the statistics.
+    void TimeParsing(void (Parser::*nonTerminal)());
+
     void ReportError(const std::string &message);
 
     // Check if this token matches the target. If so, the token is removed from
@@ -70,14 +230,49 @@ private:
     // adds the variable to the array, increases lastVar and returns it.
     int FindOrAddVariable(const std::string &variableName);
 
+    // FindOrAddVariable for a variable being assigned: in a PARALLEL FOR
+    // only the private words may be assigned.
+    int AssignedVariable(const std::string &variableName);
+
+    // Returns the address of the private word of a PARALLEL FOR, allocating
+    // the next one for a new name.
+    int PrivateVariable(const std::string &variableName);
+
+    // Check if the current token is the name of an array.
+    bool SeeArray();
+
+    // Returns the address of the first element of the array.
+    int FindArray(const std::string &arrayName);
+
+    // Allocates size consecutive words for the array.
+    void AddArray(const std::string &arrayName, Word size);
+
+    // Declares a name for the value.
+    void AddConstant(const std::string &constantName, Word value);
+
 private:
-    std::ostream &m_OutputStream;
+    std::ostream &m_ErrorStream;
     Scanner m_Scanner;
-    CodeGen m_Codegen;
-    VarTable m_Variables;
+    // Code generator and variables owned by the parser of the whole program.
+    std::unique_ptr<CodeGen> m_OwnCodegen;
+    SymbolTable m_OwnSymbols;
+    CodeGen &m_Codegen;
+    SymbolTable &m_Symbols;
+    // Variables used by the statement being parsed (may be null).
+    std::vector<std::string> *m_References = nullptr;
+    // Declared procedures and their numbers.
+    std::vector<Procedure> m_Procedures;
+    std::map<std::string, int> m_ProcedureNumbers;
+    // Name and parameters of the procedure being compiled.
+    std::string m_ProcedureName;
+    VarTable m_Parameters;
+    // Number of the loops around the statement being compiled.
+    int m_LoopDepth = 0;
+    // Private words of the PARALLEL FOR being compiled (see ParallelFor).
+    bool m_Parallel = false;
+    VarTable m_Private;
+    CompileStats *m_Stats;
     bool m_IsError = false;
-    // the number of the last recorded variable
-    int m_LastVariable = 0;
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cctype>
+#include <limits>
 
 #include "scanner.h"
 
@@ -15,33 +16,59 @@ static const char *s_TokenNames[] = {
     "'ELSE'",
     "'FI'",
     "'WHILE'",
+    "'FOR'",
     "'DO'",
     "'OD'",
     "'WRITE'",
     "'READ'",
+    "'ARRAY'",
+    "'PROCEDURE'",
+    "'AND'",
+    "'OR'",
+    "'NOT'",
+    "'CASE'",
+    "'OF'",
+    "'ESAC'",
+    "'CONST'",
     "':='",
     "'+' or '-'",
     "'*' or '/'",
     "comparison operator",
     "'('",
     "')'",
+    "'['",
+    "']'",
     "';'",
+    "','",
+    "':'",
+    "'|'",
 };
 
-Scanner::Scanner(const std::string &fileName, std::istream &input)
-    : m_FileName(fileName), m_InputStream(input) {
-    m_Keywords["begin"] = Token::Begin;
-    m_Keywords["end"] = Token::End;
-    m_Keywords["if"] = Token::If;
-    m_Keywords["then"] = Token::Then;
-    m_Keywords["else"] = Token::Else;
-    m_Keywords["fi"] = Token::Fi;
-    m_Keywords["while"] = Token::While;
-    m_Keywords["do"] = Token::Do;
-    m_Keywords["od"] = Token::Od;
-    m_Keywords["write"] = Token::Write;
-    m_Keywords["read"] = Token::Read;
+using KeywordTable = std::map<std::string, Token>;
+
+// The keyword table is built once and shared by all the scanners, so creating
+// a scanner for every compiled program costs nothing.
+static const KeywordTable &Keywords() {
+    static const KeywordTable keywords = {
+        {"begin", Token::Begin}, {"end", Token::End},
+        {"if", Token::If},       {"then", Token::Then},
+        {"else", Token::Else},   {"fi", Token::Fi},
+        {"while", Token::While}, {"do", Token::Do},
+        {"od", Token::Od},       {"write", Token::Write},
+        {"read", Token::Read},   {"array", Token::Array},
+        {"for", Token::For},     {"procedure", Token::Procedure},
+        {"and", Token::And},     {"or", Token::Or},
+        {"not", Token::Not},     {"case", Token::Case},
+        {"of", Token::Of},       {"esac", Token::Esac},
+        {"const", Token::Const},
+    };
+    return keywords;
+}
 
+Scanner::Scanner(const std::string &fileName, std::istream &input,
+                 int lineNumber, CompileStats *stats)
+    : m_FileName(fileName), m_LineNumber(lineNumber), m_InputStream(input),
+      m_Stats(stats) {
     ExtractNextChar();
 }
 
@@ -53,14 +80,22 @@ int Scanner::GetLineNumber() const {
     return m_LineNumber;
 }
 
+long Scanner::GetTokenPosition() const {
+    return m_TokenPosition;
+}
+
 Token Scanner::GetCurrentToken() const {
     return m_CurrentToken;
 }
 
-int Scanner::GetIntValue() const {
+Word Scanner::GetIntValue() const {
     return m_IntValue;
 }
 
+bool Scanner::IsIntOverflow() const {
+    return m_IntOverflow;
+}
+
 std::string Scanner::GetStringValue() const {
     return m_StringValue;
 }
@@ -82,10 +117,25 @@ static bool IsIdentifierBody(char c) {
 }
 
 void Scanner::ExtractNextToken() {
+    if (!m_Stats) {
+        ExtractToken();
+        return;
+    }
+
+    CompileStats::Clock::time_point start = CompileStats::Clock::now();
+    long position = m_Position;
+    ExtractToken();
+    m_Stats->scanSeconds += SecondsSince(start);
+    m_Stats->bytes += m_Position - position;
+    ++m_Stats->tokens;
+}
+
+void Scanner::ExtractToken() {
     SkipSpace();
 
     // Skip the comments.
     while (m_CurrentChar == '/') {
+        long slashPosition = m_Position - 1;
         ExtractNextChar();
         if (m_CurrentChar == '*') {
             ExtractNextChar();
@@ -110,6 +160,7 @@ void Scanner::ExtractNextToken() {
                 SkipSpace();
             }
         } else {
+            m_TokenPosition = slashPosition;
             m_CurrentToken = Token::MulOp;
             m_ArithmeticValue = Arithmetic::Divide;
             return;
@@ -118,19 +169,29 @@ void Scanner::ExtractNextToken() {
         SkipSpace();
     }
 
+    // m_CurrentChar is the first character of the lexeme.
+    m_TokenPosition = m_Position - 1;
+
     if (m_InputStream.eof()) {
         m_CurrentToken = Token::Eof;
         return;
     }
 
     if (std::isdigit(m_CurrentChar)) {
-        int value = 0;
+        Word value = 0;
+        bool overflow = false;
         while (std::isdigit(m_CurrentChar)) {
-            value = value * 10 + (m_CurrentChar - '0');
+            int digit = m_CurrentChar - '0';
+            if (value > (std::numeric_limits<Word>::max() - digit) / 10) {
+                overflow = true;
+            } else {
+                value = value * 10 + digit;
+            }
             ExtractNextChar();
         }
         m_CurrentToken = Token::Number;
         m_IntValue = value;
+        m_IntOverflow = overflow;
     } else if (IsIdentifierStart(m_CurrentChar)) {
         std::string buffer;
         while (IsIdentifierBody(m_CurrentChar)) {
@@ -141,8 +202,8 @@ void Scanner::ExtractNextToken() {
         std::transform(buffer.begin(), buffer.end(), buffer.begin(),
                        [](unsigned char c) { return std::tolower(c); });
 
-        std::map<std::string, Token>::iterator kwd = m_Keywords.find(buffer);
-        if (kwd == m_Keywords.end()) {
+        KeywordTable::const_iterator kwd = Keywords().find(buffer);
+        if (kwd == Keywords().end()) {
             m_CurrentToken = Token::Identifier;
             m_StringValue = buffer;
         } else {
@@ -160,11 +221,31 @@ void Scanner::ExtractNextToken() {
             ExtractNextChar();
             break;
 
+        case '[':
+            m_CurrentToken = Token::LeftBracket;
+            ExtractNextChar();
+            break;
+
+        case ']':
+            m_CurrentToken = Token::RightBracket;
+            ExtractNextChar();
+            break;
+
         case ';':
             m_CurrentToken = Token::Semicolon;
             ExtractNextChar();
             break;
 
+        case ',':
+            m_CurrentToken = Token::Comma;
+            ExtractNextChar();
+            break;
+
+        case '|':
+            m_CurrentToken = Token::Bar;
+            ExtractNextChar();
+            break;
+
         case ':':
             ExtractNextChar();
             if (m_CurrentChar == '=') {
@@ -172,7 +253,7 @@ void Scanner::ExtractNextToken() {
                 ExtractNextChar();
 
             } else {
-                m_CurrentToken = Token::Illegal;
+                m_CurrentToken = Token::Colon;
             }
             break;
 
@@ -252,6 +333,7 @@ void Scanner::SkipSpace() {
 
 void Scanner::ExtractNextChar() {
     m_CurrentChar = m_InputStream.get();
+    ++m_Position;
 }
 
 const char *TokenToString(Token t) {
@@ -5,6 +5,9 @@
 #include <map>
 #include <string>
 
+#include "stats.h"
+#include "word.h"
+
 enum class Token {
     Eof,
     Illegal,
@@ -17,17 +20,32 @@ enum class Token {
     Else,
     Fi,
     While,
+    For,
     Do,
     Od,
     Write,
     Read,
+    Array,
+    Procedure,
+    And,
+    Or,
+    Not,
+    Case,
+    Of,
+    Esac,
+    Const,
     Assign,
     AddOp, // lexeme for "+" and "-"
     MulOp, // lexeme for "*" and "/"
     Cmp,
     LeftParen,
     RightParen,
+    LeftBracket,
+    RightBracket,
     Semicolon,
+    Comma,
+    Colon,
+    Bar,
 };
 
 // Returns lexeme description.
@@ -54,12 +72,19 @@ enum class Arithmetic {
 // Lexial analyzer.
 class Scanner {
 public:
-    explicit Scanner(const std::string &fileName, std::istream &input);
+    // The input starts at the specified line of the file. If stats is not
+    // null, the scanning time and counters are added to it.
+    explicit Scanner(const std::string &fileName, std::istream &input,
+                     int lineNumber = 1, CompileStats *stats = nullptr);
 
     const std::string &GetFileName() const;
     int GetLineNumber() const;
+    // Offset of the current lexeme from the start of the input.
+    long GetTokenPosition() const;
     Token GetCurrentToken() const;
-    int GetIntValue() const;
+    Word GetIntValue() const;
+    // True if the last number does not fit in a Word.
+    bool IsIntOverflow() const;
     std::string GetStringValue() const;
     Comparison GetCmpValue() const;
     Arithmetic GetArithmeticValue() const;
@@ -69,6 +94,8 @@ public:
     void ExtractNextToken();
 
 private:
+    void ExtractToken();
+
     void ExtractNextChar();
 
     // Skip all the whitespace characters.
@@ -78,15 +105,19 @@ private:
 private:
     const std::string m_FileName;
     int m_LineNumber = 1;
+    // Number of characters extracted from the stream.
+    long m_Position = 0;
+    long m_TokenPosition = 0;
     char m_CurrentChar;
     Token m_CurrentToken;
-    int m_IntValue = 0;
+    Word m_IntValue = 0;
+    bool m_IntOverflow = false;
     // Variable name
     std::string m_StringValue;
     Comparison m_CmpValue;
     Arithmetic m_ArithmeticValue;
-    std::map<std::string, Token> m_Keywords;
     std::istream &m_InputStream;
+    CompileStats *m_Stats;
 };
 
 #endif // CMILAN_SCANNER_H
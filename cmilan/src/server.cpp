@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "threadpool.h"
+
+static volatile std::sig_atomic_t s_Stop = 0;
+
+// Limits of a request: the header line, and the name and the source of the
+// program. A larger request is rejected before its data is read.
+static const std::size_t s_MaxHeaderSize = 256;
+static const std::size_t s_MaxRequestSize = 64 << 20;
+
+// Pipe waking the server thread up from poll(): written by the signal
+// handler and when a request has been served.
+static int s_WakeUp[2] = {-1, -1};
+
+static void WakeUp() {
+    char byte = 0;
+    ssize_t written = write(s_WakeUp[1], &byte, 1);
+    (void)written;
+}
+
+static void StopHandler(int) {
+    int savedErrno = errno;
+    s_Stop = 1;
+    WakeUp();
+    errno = savedErrno;
+}
+
+static bool WriteAll(int fd, const char *data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+namespace {
+
+// Buffered reading from a socket: the header line and the data following it
+// usually arrive together and are taken with one read().
+class SocketReader {
+public:
+    explicit SocketReader(int fd) : m_Fd(fd) {}
+
+    // Read the header line (without the new line character). Fails if the
+    // line is longer than maxSize.
+    bool ReadLine(std::string &line, std::size_t maxSize);
+
+    // Read exactly size bytes.
+    bool ReadAll(std::string &data, std::size_t size);
+
+    // Is any data left in the buffer?
+    bool Buffered() const { return m_Position < m_Size; }
+
+private:
+    // Read more data into the empty buffer.
+    bool Fill();
+
+    int m_Fd;
+    char m_Buffer[4096];
+    std::size_t m_Position = 0;
+    std::size_t m_Size = 0;
+};
+
+// Connection of a client. Between the requests it waits in poll() of the
+// server thread, so an idle client does not hold a worker thread; every
+// request is served by a task of the pool.
+struct Connection {
+    explicit Connection(int fd) : fd(fd), reader(fd) {}
+
+    int fd;
+    SocketReader reader;
+    // A task is serving the request (changed by the server thread only).
+    bool busy = false;
+};
+
+// Connections whose request has been served, handed back from the workers
+// to the server thread.
+class ServedList {
+public:
+    // Add the connection (open = false if it must be closed) and wake the
+    // server thread up.
+    void Add(Connection *connection, bool open);
+    std::vector<std::pair<Connection *, bool>> Take();
+
+private:
+    std::mutex m_Mutex;
+    std::vector<std::pair<Connection *, bool>> m_Connections;
+};
+
+} // namespace
+
+bool SocketReader::Fill() {
+    for (;;) {
+        ssize_t count = read(m_Fd, m_Buffer, sizeof(m_Buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        m_Position = 0;
+        m_Size = count;
+        return true;
+    }
+}
+
+bool SocketReader::ReadLine(std::string &line, std::size_t maxSize) {
+    line.clear();
+    for (;;) {
+        if (m_Position == m_Size && !Fill()) {
+            return false;
+        }
+        const char *start = m_Buffer + m_Position;
+        const char *end = static_cast<const char *>(
+            std::memchr(start, '\n', m_Size - m_Position));
+        std::size_t length = end ? end - start : m_Size - m_Position;
+        if (line.size() + length > maxSize) {
+            return false;
+        }
+        line.append(start, length);
+        m_Position += length;
+        if (end) {
+            ++m_Position;
+            return true;
+        }
+    }
+}
+
+bool SocketReader::ReadAll(std::string &data, std::size_t size) {
+    data.resize(size);
+    std::size_t done = std::min(size, m_Size - m_Position);
+    std::memcpy(&data[0], m_Buffer + m_Position, done);
+    m_Position += done;
+
+    // The rest goes straight to the string.
+    while (done < size) {
+        ssize_t count = read(m_Fd, &data[done], size - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+void ServedList::Add(Connection *connection, bool open) {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Connections.emplace_back(connection, open);
+    }
+    WakeUp();
+}
+
+std::vector<std::pair<Connection *, bool>> ServedList::Take() {
+    std::vector<std::pair<Connection *, bool>> connections;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    connections.swap(m_Connections);
+    return connections;
+}
+
+static bool MakeAddress(const std::string &socketPath, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path '" << socketPath << "' is too long"
+                  << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    return true;
+}
+
+static int Connect(const std::string &socketPath) {
+    sockaddr_un address;
+    if (!MakeAddress(socketPath, address)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool WriteResponse(int fd, const CompileResult &result) {
+    std::ostringstream response;
+    response << (result.success ? 1 : 0) << ' ' << result.code.size() << ' '
+             << result.diagnostics.size() << '\n'
+             << result.code << result.diagnostics;
+    std::string text = response.str();
+    return WriteAll(fd, text.data(), text.size());
+}
+
+// Serve a single request of the connection. Returns false if the
+// connection must be closed.
+static bool ServeRequest(Connection &connection,
+                         const CompileOptions &options) {
+    std::string header;
+    if (!connection.reader.ReadLine(header, s_MaxHeaderSize)) {
+        return false;
+    }
+
+    std::istringstream fields(header);
+    std::string command;
+    std::size_t nameSize = 0;
+    std::size_t sourceSize = 0;
+    if (!(fields >> command >> nameSize >> sourceSize) ||
+        command != "COMPILE") {
+        return false;
+    }
+    if (nameSize > s_MaxRequestSize ||
+        sourceSize > s_MaxRequestSize - nameSize) {
+        // The data is not read, so the connection cannot go on.
+        CompileResult result;
+        result.diagnostics = "Request is too large (at most " +
+                             std::to_string(s_MaxRequestSize) + " bytes)\n";
+        WriteResponse(connection.fd, result);
+        return false;
+    }
+
+    std::string name;
+    std::string source;
+    if (!connection.reader.ReadAll(name, nameSize) ||
+        !connection.reader.ReadAll(source, sourceSize)) {
+        return false;
+    }
+    return WriteResponse(connection.fd, CompileText(name, source, options));
+}
+
+int RunServer(const std::string &socketPath, const CompileOptions &options,
+              unsigned jobs) {
+    sockaddr_un address;
+    if (!MakeAddress(socketPath, address)) {
+        return EXIT_FAILURE;
+    }
+
+    // Don't steal the socket of a running server, but remove a stale one.
+    int probe = Connect(socketPath);
+    if (probe >= 0) {
+        close(probe);
+        std::cerr << "Server is already running on '" << socketPath << "'"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    unlink(socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0 ||
+        listen(listener, SOMAXCONN) < 0) {
+        std::perror(socketPath.c_str());
+        if (listener >= 0) {
+            close(listener);
+        }
+        return EXIT_FAILURE;
+    }
+
+    // The handler writes to the pipe, so a signal arriving right before
+    // poll() is not lost.
+    if (pipe(s_WakeUp) < 0) {
+        std::perror("pipe");
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    fcntl(s_WakeUp[0], F_SETFL, O_NONBLOCK);
+    fcntl(s_WakeUp[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = StopHandler;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (jobs == 0) {
+        jobs = std::thread::hardware_concurrency();
+    }
+
+    std::cerr << "Listening on '" << socketPath << "'" << std::endl;
+    {
+        // The connections are opened and closed by this thread only, so a
+        // descriptor is never reused while a worker still holds it.
+        std::map<int, std::unique_ptr<Connection>> connections;
+        ServedList served;
+        ThreadPool pool(jobs);
+
+        auto serve = [&options, &served, &pool](Connection *connection) {
+            connection->busy = true;
+            pool.Submit([connection, &options, &served] {
+                served.Add(connection, ServeRequest(*connection, options));
+            });
+        };
+
+        std::vector<pollfd> waiting;
+        while (!s_Stop) {
+            waiting.clear();
+            waiting.push_back({s_WakeUp[0], POLLIN, 0});
+            waiting.push_back({listener, POLLIN, 0});
+            for (const auto &item : connections) {
+                if (!item.second->busy) {
+                    waiting.push_back({item.first, POLLIN, 0});
+                }
+            }
+            if (poll(waiting.data(), waiting.size(), -1) < 0) {
+                if (errno != EINTR) {
+                    std::perror("poll");
+                }
+                continue;
+            }
+
+            if (waiting[0].revents) {
+                char bytes[64];
+                while (read(s_WakeUp[0], bytes, sizeof(bytes)) > 0) {
+                }
+            }
+            for (const auto &item : served.Take()) {
+                Connection *connection = item.first;
+                connection->busy = false;
+                if (!item.second) {
+                    close(connection->fd);
+                    connections.erase(connection->fd);
+                } else if (connection->reader.Buffered()) {
+                    // The next request has already been read, poll() would
+                    // not report it.
+                    serve(connection);
+                }
+            }
+            if (s_Stop) {
+                break;
+            }
+
+            for (std::size_t i = 2; i < waiting.size(); ++i) {
+                if (waiting[i].revents) {
+                    serve(connections[waiting[i].fd].get());
+                }
+            }
+            if (waiting[1].revents & POLLIN) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    connections[fd] = std::make_unique<Connection>(fd);
+                } else if (errno != EINTR) {
+                    std::perror("accept");
+                }
+            }
+        }
+
+        // Finish the requests already received; the connections waiting for
+        // the next request are closed.
+        close(listener);
+        for (const auto &item : connections) {
+            if (item.second->busy) {
+                shutdown(item.first, SHUT_RD);
+            }
+        }
+        pool.Wait();
+        for (const auto &item : connections) {
+            close(item.first);
+        }
+    }
+    int wakeUp[2] = {s_WakeUp[0], s_WakeUp[1]};
+    s_WakeUp[0] = s_WakeUp[1] = -1;
+    close(wakeUp[0]);
+    close(wakeUp[1]);
+    unlink(socketPath.c_str());
+    return EXIT_SUCCESS;
+}
+
+int RunClient(const std::string &socketPath, const std::string &inputPath) {
+    std::string source;
+    if (!ReadFile(inputPath, source)) {
+        std::cerr << "File '" << inputPath << "' not found" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int fd = Connect(socketPath);
+    if (fd < 0) {
+        std::cerr << "Unable to connect to '" << socketPath
+                  << "': " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ostringstream request;
+    request << "COMPILE " << inputPath.size() << ' ' << source.size() << '\n'
+            << inputPath << source;
+    std::string text = request.str();
+
+    std::string header;
+    int success = 0;
+    std::size_t codeSize = 0;
+    std::size_t diagnosticsSize = 0;
+    std::string code;
+    std::string diagnostics;
+
+    SocketReader reader(fd);
+    bool ok = WriteAll(fd, text.data(), text.size()) &&
+              reader.ReadLine(header, s_MaxHeaderSize);
+    if (ok) {
+        std::istringstream fields(header);
+        ok = static_cast<bool>(fields >> success >> codeSize >>
+                               diagnosticsSize) &&
+             reader.ReadAll(code, codeSize) &&
+             reader.ReadAll(diagnostics, diagnosticsSize);
+    }
+    close(fd);
+
+    if (!ok) {
+        std::cerr << "Connection to '" << socketPath << "' failed"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << code;
+    std::cout.flush();
+    std::cerr << diagnostics;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
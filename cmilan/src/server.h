@@ -0,0 +1,36 @@
+#ifndef CMILAN_SERVER_H
+#define CMILAN_SERVER_H
+
+#include <string>
+
+#include "driver.h"
+
+/* Resident compile server.
+ *
+ * The server listens on a local UNIX socket and compiles the programs sent
+ * by the clients, so the process startup is paid only once. A connection may
+ * carry any number of requests. The idle connections wait in poll() of the
+ * server thread and every request is served by a pool of worker threads (at
+ * most "jobs" requests at once), so idle clients do not hold the workers.
+ * The keyword table and the compile cache are shared by all the requests.
+ *
+ * Protocol (all numbers are decimal, the header ends with a new line):
+ *   request:  "COMPILE <name length> <source length>\n" <name> <source>
+ *   response: "<0 or 1> <code length> <diagnostics length>\n" <code>
+ *             <diagnostics>
+ * where 1 means the program was compiled successfully. A request larger than
+ * 64 MB gets a response with the error in the diagnostics, and the
+ * connection is closed. When the server stops, the requests already
+ * received are answered and the idle connections are closed.
+ * */
+
+// Serve requests until SIGINT or SIGTERM. Returns the exit status.
+int RunServer(const std::string &socketPath, const CompileOptions &options,
+              unsigned jobs);
+
+// Compile the file on the server and print the code and the diagnostics
+// just like the compiler itself does. Returns the exit status (a failure if
+// the program has errors).
+int RunClient(const std::string &socketPath, const std::string &inputPath);
+
+#endif // CMILAN_SERVER_H
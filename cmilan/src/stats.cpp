@@ -0,0 +1,90 @@
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "stats.h"
+
+CompileStats &CompileStats::operator+=(const CompileStats &other) {
+    files += other.files;
+    cacheHits += other.cacheHits;
+    scanSeconds += other.scanSeconds;
+    tokens += other.tokens;
+    bytes += other.bytes;
+    parseSeconds += other.parseSeconds;
+    statements += other.statements;
+    reusedStatements += other.reusedStatements;
+    errors += other.errors;
+    recoveries += other.recoveries;
+    instructions += other.instructions;
+    reserved += other.reserved;
+    backpatches += other.backpatches;
+    combined += other.combined;
+    initializers += other.initializers;
+    calls += other.calls;
+    inlinedCalls += other.inlinedCalls;
+    outputSeconds += other.outputSeconds;
+    outputBytes += other.outputBytes;
+    return *this;
+}
+
+// Peak resident set size of the process in kilobytes.
+static long PeakMemory() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+void PrintTimeReport(const CompileStats &stats, double wallSeconds, bool json,
+                     std::ostream &os) {
+    long peakMemory = PeakMemory();
+
+    if (json) {
+        os << "{\"files\": " << stats.files
+           << ", \"cache_hits\": " << stats.cacheHits
+           << ", \"wall_seconds\": " << wallSeconds
+           << ", \"peak_memory_kb\": " << peakMemory
+           << ", \"scan\": {\"seconds\": " << stats.scanSeconds
+           << ", \"tokens\": " << stats.tokens
+           << ", \"bytes\": " << stats.bytes << "}"
+           << ", \"parse\": {\"seconds\": " << stats.parseSeconds
+           << ", \"statements\": " << stats.statements
+           << ", \"reused_statements\": " << stats.reusedStatements
+           << ", \"errors\": " << stats.errors
+           << ", \"recoveries\": " << stats.recoveries << "}"
+           << ", \"codegen\": {\"instructions\": " << stats.instructions
+           << ", \"reserved\": " << stats.reserved
+           << ", \"backpatches\": " << stats.backpatches
+           << ", \"combined\": " << stats.combined
+           << ", \"initializers\": " << stats.initializers
+           << ", \"calls\": " << stats.calls
+           << ", \"inlined_calls\": " << stats.inlinedCalls << "}"
+           << ", \"output\": {\"seconds\": " << stats.outputSeconds
+           << ", \"bytes\": " << stats.outputBytes << "}}" << std::endl;
+        return;
+    }
+
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+    os << "Phase            Time (ms)  Counters" << std::endl;
+    os << "scanning     " << std::setw(13) << stats.scanSeconds * 1000
+       << "  tokens " << stats.tokens << ", bytes " << stats.bytes
+       << std::endl;
+    os << "parsing      " << std::setw(13) << stats.parseSeconds * 1000
+       << "  statements " << stats.statements << " (" << stats.reusedStatements
+       << " reused), errors " << stats.errors
+       << ", recoveries " << stats.recoveries << std::endl;
+    os << "codegen      " << std::setw(13) << "-"
+       << "  instructions " << stats.instructions << ", reserved "
+       << stats.reserved << ", backpatches " << stats.backpatches
+       << ", combined " << stats.combined << ", initializers "
+       << stats.initializers << ", calls " << stats.calls << " ("
+       << stats.inlinedCalls << " inlined)" << std::endl;
+    os << "output       " << std::setw(13) << stats.outputSeconds * 1000
+       << "  bytes " << stats.outputBytes << std::endl;
+    os << "total        " << std::setw(13) << wallSeconds * 1000 << "  files "
+       << stats.files << ", cache hits " << stats.cacheHits << std::endl;
+    os << "peak memory " << peakMemory << " KB" << std::endl;
+    os.flags(flags);
+}
@@ -0,0 +1,63 @@
+#ifndef CMILAN_STATS_H
+#define CMILAN_STATS_H
+
+#include <chrono>
+#include <ostream>
+
+// Counters and timings of the compilation phases.
+// Code generation is interleaved with parsing, so its time is a part of the
+// parsing time.
+struct CompileStats {
+    using Clock = std::chrono::steady_clock;
+
+    // Files compiled (including the cache hits).
+    long files = 0;
+    long cacheHits = 0;
+
+    // Scanning.
+    double scanSeconds = 0;
+    long tokens = 0;
+    long bytes = 0;
+
+    // Parsing.
+    double parseSeconds = 0;
+    long statements = 0;
+    // Top-level statements taken from the incremental compilation state.
+    long reusedStatements = 0;
+    long errors = 0;
+    long recoveries = 0;
+
+    // Code generation.
+    long instructions = 0;
+    // Instructions reserved by CodeGen::reserve() and set by
+    // CodeGen::emitAt().
+    long reserved = 0;
+    long backpatches = 0;
+    // Instructions saved by combining sequences into the instructions with
+    // immediate and memory operands and by folding operations on constants.
+    long combined = 0;
+    // Assignments at the start of the program output as SET lines.
+    long initializers = 0;
+    // Procedure calls compiled to CALL and copied in place of the call.
+    long calls = 0;
+    long inlinedCalls = 0;
+
+    // Output.
+    double outputSeconds = 0;
+    long outputBytes = 0;
+
+    CompileStats &operator+=(const CompileStats &other);
+};
+
+// Seconds elapsed since the start.
+inline double SecondsSince(CompileStats::Clock::time_point start) {
+    return std::chrono::duration<double>(CompileStats::Clock::now() - start)
+        .count();
+}
+
+// Print the report as a table or as a JSON object. wallSeconds is the time
+// of the whole run.
+void PrintTimeReport(const CompileStats &stats, double wallSeconds, bool json,
+                     std::ostream &os);
+
+#endif // CMILAN_STATS_H
@@ -0,0 +1,62 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+
+    m_Workers.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_TaskAvailable.notify_all();
+
+    for (std::thread &worker : m_Workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Tasks.push(std::move(task));
+        ++m_Pending;
+    }
+    m_TaskAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_TasksDone.wait(lock, [this] { return m_Pending == 0; });
+}
+
+void ThreadPool::WorkerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_TaskAvailable.wait(
+                lock, [this] { return m_Stopping || !m_Tasks.empty(); });
+            if (m_Tasks.empty()) {
+                // Stopping and nothing left to do.
+                return;
+            }
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop();
+        }
+
+        task();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (--m_Pending == 0) {
+            m_TasksDone.notify_all();
+        }
+    }
+}
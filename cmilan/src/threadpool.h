@@ -0,0 +1,44 @@
+#ifndef CMILAN_THREADPOOL_H
+#define CMILAN_THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads.
+// Tasks are executed in the order of submission, but may finish in any order.
+class ThreadPool {
+public:
+    // Start the specified number of workers (at least one).
+    explicit ThreadPool(unsigned threadCount);
+
+    // Wait for the queued tasks and stop the workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Add task to the queue.
+    void Submit(std::function<void()> task);
+
+    // Block until all submitted tasks are finished.
+    void Wait();
+
+private:
+    void WorkerLoop();
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_TaskAvailable;
+    std::condition_variable m_TasksDone;
+    // Number of tasks that are queued or being executed.
+    unsigned m_Pending = 0;
+    bool m_Stopping = false;
+};
+
+#endif // CMILAN_THREADPOOL_H
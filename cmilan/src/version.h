@@ -0,0 +1,8 @@
+#ifndef CMILAN_VERSION_H
+#define CMILAN_VERSION_H
+
+// Compiler version. Must be changed every time the generated code for the
+// same source may change, since it is a part of the compile cache key.
+#define CMILAN_VERSION "1.13"
+
+#endif // CMILAN_VERSION_H
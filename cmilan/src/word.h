@@ -0,0 +1,11 @@
+#ifndef CMILAN_WORD_H
+#define CMILAN_WORD_H
+
+#include <cstdint>
+
+// Integer value of Milan programs. The compiler keeps literals at the
+// widest word of the virtual machine (64 bits); a VM built with narrower
+// words rejects the literals which do not fit when loading the program.
+using Word = std::int64_t;
+
+#endif // CMILAN_WORD_H
@@ -0,0 +1,42 @@
+#!/bin/sh
+#      60000 
+#     flex/bison.
+#
+#    vm  make: sh bench/load_bench.sh []
+
+MVM=${MVM:-./mvm}
+RUNS=${1:-20}
+PROGRAM=${TMPDIR:-/tmp}/load_bench.ms
+
+awk 'BEGIN {
+        print "; 60000 commands"
+        for (i = 0; i < 100; ++i) {
+                printf "SET\t%d\t\t%d\n", i, i * 7
+        }
+        for (a = 0; a < 60000; a += 6) {
+                printf "%d:\tLOAD\t\t%d\t; x := x + 1\n", a, a % 100
+                printf "%d:\tPUSH\t\t1\n", a + 1
+                printf "%d:\tADD\n", a + 2
+                printf "%d:\tSTORE\t\t%d\n", a + 3, a % 100
+                printf "%d:\tCOMPARE\t\t2\n", a + 4
+                printf "%d:\tJUMP_NO\t\t%d\n", a + 5, a + 6
+        }
+}' > "$PROGRAM"
+
+measure() {
+        start=$(date +%s%N)
+        i=0
+        while [ $i -lt "$RUNS" ]; do
+                "$MVM" "$@" --load-only "$PROGRAM" > /dev/null || exit 1
+                i=$((i + 1))
+        done
+        end=$(date +%s%N)
+        echo "$(( (end - start) / RUNS / 1000 )) us per load"
+}
+
+printf "flex/bison loader: "
+measure --legacy-loader
+printf "built-in loader:   "
+measure
+
+rm -f "$PROGRAM"
@@ -0,0 +1,103 @@
+#!/bin/sh
+#   32-  64-   
+#          1M .
+#
+#    vm  make mvm mvm64: sh bench/word_bench.sh
+# (     MVMS)
+
+DIR=${TMPDIR:-/tmp}
+ARITH=$DIR/word_bench_arith.ms
+ARRAY=$DIR/word_bench_array.ms
+
+# s := s + i * 3 - i / 2  i  0  10000000
+cat > "$ARITH" <<'END'
+SET 0 0         ; i
+SET 1 0         ; s
+ 0: LOAD 0
+ 1: PUSH 10000000
+ 2: COMPARE 2   ; i < 10000000
+ 3: JUMP_NO 20
+ 4: LOAD 1
+ 5: LOAD 0
+ 6: PUSH 3
+ 7: MULT
+ 8: ADD
+ 9: LOAD 0
+10: PUSH 2
+11: DIV
+12: SUB
+13: STORE 1
+14: LOAD 0
+15: PUSH 1
+16: ADD
+17: STORE 0
+18: JUMP 0
+19: NOP
+20: LOAD 1
+21: PRINT
+22: STOP
+END
+
+# a[i] := i,  20  s := s + a[i]   
+cat > "$ARRAY" <<'END'
+MEMORY_SIZE 1048700
+SET 0 0         ; i
+SET 1 0         ; s
+SET 2 0         ; 
+ 0: LOAD 0
+ 1: PUSH 1048576
+ 2: COMPARE 2
+ 3: JUMP_NO 13
+ 4: LOAD 0
+ 5: LOAD 0
+ 6: BSTORE 100  ; a[i] := i
+ 7: LOAD 0
+ 8: PUSH 1
+ 9: ADD
+10: STORE 0
+11: JUMP 0
+12: NOP
+13: PUSH 0
+14: STORE 0
+15: LOAD 0
+16: PUSH 1048576
+17: COMPARE 2
+18: JUMP_NO 30
+19: LOAD 1
+20: LOAD 0
+21: BLOAD 100   ; s := s + a[i]
+22: ADD
+23: STORE 1
+24: LOAD 0
+25: PUSH 1
+26: ADD
+27: STORE 0
+28: JUMP 15
+29: NOP
+30: LOAD 2
+31: PUSH 1
+32: ADD
+33: DUP
+34: STORE 2
+35: PUSH 20
+36: COMPARE 2
+37: JUMP_YES 13
+38: LOAD 1
+39: PRINT
+40: STOP
+END
+
+measure() {
+        start=$(date +%s%N)
+        result=$("$1" --batch-io "$2") || exit 1
+        end=$(date +%s%N)
+        printf "%-6s %-6s %6d ms  (result %s)\n" "$(basename "$1")" "$3" \
+                $(( (end - start) / 1000000 )) "$result"
+}
+
+for mvm in ${MVMS:-./mvm ./mvm64}; do
+        measure $mvm "$ARITH" arith
+        measure $mvm "$ARRAY" array
+done
+
+rm -f "$ARITH" "$ARRAY"
@@ -680,7 +680,7 @@ YY_RULE_SETUP
 case 4:
 YY_RULE_SETUP
 #line 22 "vmlex.l"
-{ yylval = atoi(yytext); return T_INT; }
+{ return legacy_number(yytext, &yylval) ? T_INT : YYerror; }
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "vm.h"
+#include "loader.h"
+
+/*      .
+ *
+ *   -     operation_info(), SET
+ *    .
+ *     ,    
+ *     ,    - 
+ *      .
+ */
+
+#define KEYWORD_TABLE_BITS      7
+#define KEYWORD_TABLE_SIZE      (1 << KEYWORD_TABLE_BITS)
+
+/*   ,    (, 
+       ) */
+#define KEYWORD_SET             -1
+#define KEYWORD_PROGRAM_SIZE    -2
+#define KEYWORD_MEMORY_SIZE     -3
+#define KEYWORD_STACK_SIZE      -4
+
+typedef struct {
+        const char *name;
+        int code;
+} directive;
+
+directive directives[] = {
+        {"SET",          KEYWORD_SET},
+        {"PROGRAM_SIZE", KEYWORD_PROGRAM_SIZE},
+        {"MEMORY_SIZE",  KEYWORD_MEMORY_SIZE},
+        {"STACK_SIZE",   KEYWORD_STACK_SIZE}
+};
+
+int directives_count = sizeof(directives) / sizeof(directive);
+
+typedef struct {
+        const char *name;       /* NULL -   */
+        size_t length;
+        int code;               /*    KEYWORD_SET */
+} keyword;
+
+keyword keyword_table[KEYWORD_TABLE_SIZE];
+unsigned int keyword_multiplier = 0;
+
+unsigned int keyword_hash(const char *word, size_t length)
+{
+        unsigned int hash = 0;
+        size_t i;
+
+        for(i = 0; i < length; ++i) {
+                hash = hash * 31 + (unsigned char) word[i];
+        }
+
+        return hash;
+}
+
+unsigned int keyword_slot(unsigned int hash)
+{
+        return (hash * keyword_multiplier) >> (32 - KEYWORD_TABLE_BITS);
+}
+
+/*         */
+
+int keyword_add(const char *name, int code)
+{
+        unsigned int slot = keyword_slot(keyword_hash(name, strlen(name)));
+
+        if(keyword_table[slot].name) {
+                return 0;
+        }
+
+        keyword_table[slot].name = name;
+        keyword_table[slot].length = strlen(name);
+        keyword_table[slot].code = code;
+        return 1;
+}
+
+int keyword_table_fill()
+{
+        opcode_info *info;
+        int i;
+
+        memset(keyword_table, 0, sizeof(keyword_table));
+        for(i = 0; i < directives_count; ++i) {
+                if(!keyword_add(directives[i].name, directives[i].code)) {
+                        return 0;
+                }
+        }
+
+        for(i = 0; NULL != (info = operation_info((operation) i)); ++i) {
+                if(!keyword_add(info->name, i)) {
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+void keyword_table_init()
+{
+        if(keyword_multiplier) {
+                return;
+        }
+
+        /*    ,  
+                  */
+        for(keyword_multiplier = 0x9E3779B1u; !keyword_table_fill();
+                        keyword_multiplier += 2) {
+        }
+}
+
+keyword *keyword_find(const char *word, size_t length)
+{
+        keyword *entry = &keyword_table[keyword_slot(keyword_hash(word, length))];
+
+        if(entry->name && entry->length == length
+                        && 0 == memcmp(entry->name, word, length)) {
+                return entry;
+        }
+
+        return NULL;
+}
+
+/*   */
+
+typedef struct {
+        const char *file_name;
+        const char *position;
+        const char *end;
+        unsigned int line;
+        const char *word;       /*    */
+        int word_length;
+} loader;
+
+int loader_error(loader *l, const char *message)
+{
+        fprintf(stderr, "%s:%u: error: %s\n", l->file_name, l->line, message);
+        return 1;
+}
+
+int is_word_char(char c)
+{
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+                || (c >= '0' && c <= '9') || '_' == c;
+}
+
+/*  ,     */
+
+void skip_blanks(loader *l)
+{
+        const char *p = l->position;
+
+        while(p < l->end) {
+                if('\n' == *p) {
+                        ++l->line;
+                        ++p;
+                }
+                else if(' ' == *p || '\t' == *p || '\r' == *p) {
+                        ++p;
+                }
+                else if(';' == *p) {
+                        while(p < l->end && '\n' != *p) {
+                                ++p;
+                        }
+                }
+                else {
+                        break;
+                }
+        }
+
+        l->position = p;
+}
+
+/*    :     
+       */
+
+void skip_spaces(loader *l)
+{
+        while(l->position < l->end && (' ' == *l->position
+                        || '\t' == *l->position || '\r' == *l->position)) {
+                ++l->position;
+        }
+}
+
+int at_number(loader *l)
+{
+        const char *p = l->position;
+
+        if(p < l->end && '-' == *p) {
+                ++p;
+        }
+
+        return p < l->end && *p >= '0' && *p <= '9';
+}
+
+/*    -?[0-9]+      */
+
+int read_number(loader *l, vm_word *value, const char *what)
+{
+        char message[64];
+        const char *p;
+        int negative = 0;
+        vm_uword number = 0;
+        vm_uword limit;
+        int overflow = 0;
+        int digit;
+
+        skip_spaces(l);
+        if(!at_number(l)) {
+                snprintf(message, sizeof(message), "%s expected", what);
+                return loader_error(l, message);
+        }
+
+        p = l->position;
+        if('-' == *p) {
+                negative = 1;
+                ++p;
+        }
+
+        limit = negative ? (vm_uword) VM_WORD_MAX + 1 : VM_WORD_MAX;
+        while(p < l->end && *p >= '0' && *p <= '9') {
+                digit = *p++ - '0';
+                if(number > (limit - digit) / 10) {
+                        overflow = 1;
+                }
+                else {
+                        number = number * 10 + digit;
+                }
+        }
+
+        if(p < l->end && is_word_char(*p)) {
+                snprintf(message, sizeof(message), "invalid %s", what);
+                return loader_error(l, message);
+        }
+        if(overflow) {
+                snprintf(message, sizeof(message), "%s is out of range", what);
+                return loader_error(l, message);
+        }
+
+        l->position = p;
+        *value = negative ? (vm_word) (0u - number) : (vm_word) number;
+        return 0;
+}
+
+/*   ; NULL -    */
+
+keyword *read_keyword(loader *l)
+{
+        const char *start;
+
+        skip_spaces(l);
+        start = l->position;
+        while(l->position < l->end && is_word_char(*l->position)) {
+                ++l->position;
+        }
+
+        l->word = start;
+        l->word_length = l->position - start;
+        return keyword_find(start, l->position - start);
+}
+
+/*       */
+
+int word_error(loader *l, const char *expected)
+{
+        char message[96];
+
+        if(0 == l->word_length) {
+                snprintf(message, sizeof(message), "%s expected", expected);
+        }
+        else {
+                snprintf(message, sizeof(message), "%s expected, \"%.*s\" found",
+                        expected, l->word_length > 32 ? 32 : l->word_length, l->word);
+        }
+
+        return loader_error(l, message);
+}
+
+segment_type segment_of(int code)
+{
+        switch(code) {
+        case KEYWORD_PROGRAM_SIZE:
+                return PROGRAM_SEGMENT;
+
+        case KEYWORD_MEMORY_SIZE:
+                return MEMORY_SEGMENT;
+
+        default:
+                return STACK_SEGMENT;
+        }
+}
+
+int parse_program(loader *l)
+{
+        keyword *word;
+        opcode_info *info;
+        vm_word address;
+        vm_word value;
+        int count = 0;
+
+        for(;;) {
+                skip_blanks(l);
+                if(l->position == l->end) {
+                        break;
+                }
+
+                if(at_number(l)) {
+                        /* :  [] */
+                        if(read_number(l, &address, "address")) {
+                                return 1;
+                        }
+                        if(address < 0 || address >= MAX_SEGMENT_SIZE) {
+                                return loader_error(l, "code address is out of range");
+                        }
+
+                        skip_spaces(l);
+                        if(l->position == l->end || ':' != *l->position) {
+                                return loader_error(l, "':' expected after address");
+                        }
+                        ++l->position;
+
+                        word = read_keyword(l);
+                        if(!word || word->code < 0) {
+                                return word_error(l, "command");
+                        }
+
+                        value = 0;
+                        info = operation_info((operation) word->code);
+                        if(info->need_arg && read_number(l, &value, "argument")) {
+                                return 1;
+                        }
+
+                        put_command(address, (operation) word->code, value);
+                }
+                else {
+                        word = read_keyword(l);
+                        if(!word || word->code >= 0) {
+                                return word_error(l, "address or SET");
+                        }
+                        else if(KEYWORD_SET == word->code) {
+                                /* SET   */
+                                if(read_number(l, &address, "address")
+                                                || read_number(l, &value, "value")) {
+                                        return 1;
+                                }
+                                if(address < 0 || address >= MAX_SEGMENT_SIZE) {
+                                        return loader_error(l, "data address is out of range");
+                                }
+
+                                set_mem(address, value);
+                        }
+                        else {
+                                /* PROGRAM_SIZE, MEMORY_SIZE  STACK_SIZE  */
+                                if(count > 0) {
+                                        return loader_error(l,
+                                                "segment sizes must precede the program");
+                                }
+                                if(read_number(l, &value, "size")) {
+                                        return 1;
+                                }
+                                if(value <= 0 || value > MAX_SEGMENT_SIZE) {
+                                        return loader_error(l, "size is out of range");
+                                }
+                                if(set_segment_size(segment_of(word->code), value)) {
+                                        return loader_error(l, "unable to allocate memory");
+                                }
+
+                                /*      */
+                                continue;
+                        }
+                }
+
+                ++count;
+        }
+
+        if(0 == count) {
+                return loader_error(l, "program is empty");
+        }
+
+        return 0;
+}
+
+/*      ( stdin  ,  
+   ) */
+
+char *read_all(int fd, size_t *size)
+{
+        size_t capacity = 65536;
+        char *buffer = malloc(capacity);
+        char *larger;
+        ssize_t count;
+
+        *size = 0;
+        while(buffer) {
+                if(*size == capacity) {
+                        capacity *= 2;
+                        larger = realloc(buffer, capacity);
+                        if(!larger) {
+                                break;
+                        }
+                        buffer = larger;
+                }
+
+                count = read(fd, buffer + *size, capacity - *size);
+                if(count < 0 && EINTR == errno) {
+                        continue;
+                }
+                if(count <= 0) {
+                        if(0 == count) {
+                                return buffer;
+                        }
+                        break;
+                }
+
+                *size += count;
+        }
+
+        free(buffer);
+        return NULL;
+}
+
+int load_program(const char *file_name)
+{
+        loader l;
+        struct stat info;
+        char *text = NULL;
+        int mapped = 0;
+        size_t size = 0;
+        int fd = STDIN_FILENO;
+        int result;
+
+        keyword_table_init();
+
+        if(file_name) {
+                fd = open(file_name, O_RDONLY);
+                if(fd < 0) {
+                        fprintf(stderr, "Unable to read %s\n", file_name);
+                        return 1;
+                }
+
+                if(0 == fstat(fd, &info) && S_ISREG(info.st_mode)) {
+                        size = info.st_size;
+                        if(0 == size) {
+                                mapped = 1;
+                        }
+                        else {
+                                text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                                if(MAP_FAILED == text) {
+                                        text = NULL;
+                                }
+                                else {
+                                        mapped = 1;
+                                }
+                        }
+                }
+        }
+
+        if(!mapped) {
+                text = read_all(fd, &size);
+                if(!text) {
+                        fprintf(stderr, "Unable to read %s\n",
+                                file_name ? file_name : "stdin");
+                        if(file_name) {
+                                close(fd);
+                        }
+                        return 1;
+                }
+        }
+
+        l.file_name = file_name ? file_name : "stdin";
+        l.position = text;
+        l.end = text + size;
+        l.line = 1;
+        result = parse_program(&l);
+
+        if(mapped) {
+                if(text) {
+                        munmap(text, size);
+                }
+        }
+        else {
+                free(text);
+        }
+        if(file_name) {
+                close(fd);
+        }
+
+        return result;
+}
@@ -0,0 +1,25 @@
+#ifndef _MILAN_LOADER_H
+#define _MILAN_LOADER_H
+
+/*  .
+ *
+ *  file_name ( stdin,  file_name  NULL) 
+ *      :  
+ * ":  []"    ,
+ *  "SET  " -   ,   ";"
+ *    .      
+ *     .
+ *
+ *        "PROGRAM_SIZE n",
+ * "MEMORY_SIZE n"  "STACK_SIZE n",   .
+ *          
+ *   .
+ *
+ *  0,   .    stderr
+ *         
+ *  1.
+ */
+
+int load_program(const char *file_name);
+
+#endif
@@ -1,7 +1,14 @@
 #include "vm.h"
+#include "loader.h"
+#include "profile.h"
+#include "trace.h"
+#include "sched.h"
+#include "parallel.h"
 #include "vmparse.tab.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 extern FILE *yyin;
 int need_close = 0;
@@ -17,29 +24,295 @@ void milan_error(char const * msg)
 	exit(1);
 }
 
-int main(int argc, char **argv)
+void usage()
+{
+        fprintf(stderr, "Usage: mvm [options] [file]\n"
+                "       mvm --tasks [options] file[,input[,output]]...\n\n"
+                "  --batch-io       read INPUT numbers from stdin and write PRINT results\n"
+                "                   to stdout in large blocks, without prompts\n"
+                "  --async-io       the same, with parsing and formatting done by\n"
+                "                   separate reader and writer threads\n"
+                "  --legacy-loader  load the program with the flex/bison parser\n"
+                "                   (no size headers, original instruction set)\n"
+                "  --load-only      load the program without running it\n"
+                "  --program-size n\n"
+                "  --memory-size n\n"
+                "  --stack-size n   set the size of the code, data or stack segment\n"
+                "                   (commands or words), overriding the program header\n"
+                "  --profile        count executions and time of every command and\n"
+                "                   print the profile to stderr\n"
+                "  --line-map file  attribute the profile to the source lines\n"
+                "                   (the map is written by cmilan --line-map)\n"
+                "  --profile-top n  number of hot lines and loops to print (10)\n"
+                "  --profile-folded file\n"
+                "                   write the profile as folded stacks for flamegraph.pl\n"
+                "  --tasks          run several programs concurrently; each program\n"
+                "                   is given as file[,input[,output]] (INPUT reads\n"
+                "                   input, /dev/null by default; PRINT writes output,\n"
+                "                   stdout by default)\n"
+                "  --workers n      number of worker threads for --tasks (one per CPU)\n"
+                "  --slice n        instructions a program runs before it is\n"
+                "                   preempted (10000)\n"
+                "  --threads n      number of threads for PARALLEL loops (one per CPU)\n"
+#ifdef VM_TRACE
+                "  --trace-file file\n"
+                "                   write the execution trace to file (mvm.trace);\n"
+                "                   read it with mvmtrace\n"
+#endif
+                );
+}
+
+/*      segment_type */
+const char *size_options[] = {
+        "--program-size", "--memory-size", "--stack-size"
+};
+
+int find_size_option(const char *option)
+{
+        int segment;
+
+        for(segment = PROGRAM_SEGMENT; segment <= STACK_SEGMENT; ++segment) {
+                if(0 == strcmp(option, size_options[segment])) {
+                        return segment;
+                }
+        }
+
+        return -1;
+}
+
+/*      ; 0 -  */
+
+unsigned int parse_size(const char *text)
+{
+        char *end;
+        unsigned long size;
+
+        errno = 0;
+        size = strtoul(text, &end, 10);
+        if(errno || end == text || *end || '-' == text[0]
+                        || 0 == size || size > MAX_SEGMENT_SIZE) {
+                return 0;
+        }
+
+        return size;
+}
+
+/*        */
+
+int apply_sizes(const unsigned int *sizes)
+{
+        int segment;
+
+        for(segment = PROGRAM_SEGMENT; segment <= STACK_SEGMENT; ++segment) {
+                if(sizes[segment] && set_segment_size(segment, sizes[segment])) {
+                        fprintf(stderr, "Unable to allocate %u words for %s\n",
+                                sizes[segment], size_options[segment] + 2);
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+/*     ,   
+   "[,[,]]" */
+
+int run_tasks(char **programs, int count, const unsigned int *sizes,
+        const sched_options *options, int load_only)
+{
+        char *input;
+        char *output;
+        int i;
+
+        /*         */
+        set_io_mode(IO_BATCH);
+
+        for(i = 0; i < count; ++i) {
+                input = strchr(programs[i], ',');
+                output = NULL;
+                if(input) {
+                        *input++ = '\0';
+                        output = strchr(input, ',');
+                        if(output) {
+                                *output++ = '\0';
+                        }
+                }
+
+                vm_new_context();
+                if(0 != load_program(programs[i]) || 0 != apply_sizes(sizes)
+                                || 0 != sched_add(programs[i], input, output)) {
+                        return 1;
+                }
+        }
+
+        if(load_only) {
+                return 0;
+        }
+
+        return sched_run(options) ? 1 : 0;
+}
+
+/*   ,  flex  bison */
+
+int legacy_load(char *file_name, int batch_io)
 {
-        if(argc < 2) {
+        int result;
+
+        if(!file_name) {
                 yyin = stdin;
-                printf("Reading input from stdin\n");
         }
         else {
-                yyin = fopen(argv[1], "rt");
+                yyin = fopen(file_name, "rt");
                 if(!yyin) {
-                        printf("Unable to read %s\n", argv[1]);
+                        fprintf(batch_io ? stderr : stdout,
+                                "Unable to read %s\n", file_name);
                         return 1;
                 }
                 
                 need_close = 1;
-                printf("Reading input from %s\n", argv[1]);
-        }
-        
-        if(0 == yyparse()) {
-                run();
         }
 
+        result = yyparse();
+
         if(need_close) {
                 fclose(yyin);
+                need_close = 0;
+        }
+
+        return result;
+}
+
+int main(int argc, char **argv)
+{
+        char *file_name = NULL;
+        int batch_io = 0;
+        int legacy_loader = 0;
+        int load_only = 0;
+        int profile = 0;
+        profile_options profile_settings = {NULL, NULL, 10};
+        io_mode mode = IO_INTERACTIVE;
+        unsigned int sizes[] = {0, 0, 0};
+        int tasks = 0;
+        sched_options sched_settings = {0, DEFAULT_SLICE};
+        char **programs = calloc(argc, sizeof(char *));
+        int program_count = 0;
+        int segment;
+        int i;
+
+        for(i = 1; i < argc; ++i) {
+                if(0 == strcmp(argv[i], "--batch-io")) {
+                        mode = IO_BATCH;
+                }
+                else if(0 == strcmp(argv[i], "--async-io")) {
+                        mode = IO_ASYNC;
+                }
+                else if(0 == strcmp(argv[i], "--legacy-loader")) {
+                        legacy_loader = 1;
+                }
+                else if(0 == strcmp(argv[i], "--load-only")) {
+                        load_only = 1;
+                }
+                else if(0 == strcmp(argv[i], "--profile")) {
+                        profile = 1;
+                }
+                else if(0 == strcmp(argv[i], "--line-map") && i + 1 < argc) {
+                        profile_settings.line_map = argv[++i];
+                        profile = 1;
+                }
+                else if(0 == strcmp(argv[i], "--profile-folded") && i + 1 < argc) {
+                        profile_settings.folded = argv[++i];
+                        profile = 1;
+                }
+                else if(0 == strcmp(argv[i], "--profile-top") && i + 1 < argc) {
+                        profile_settings.top = atoi(argv[++i]);
+                        profile = 1;
+                }
+#ifdef VM_TRACE
+                else if(0 == strcmp(argv[i], "--trace-file") && i + 1 < argc) {
+                        set_trace_file(argv[++i]);
+                }
+#endif
+                else if(0 == strcmp(argv[i], "--tasks")) {
+                        tasks = 1;
+                }
+                else if(0 == strcmp(argv[i], "--workers") && i + 1 < argc) {
+                        sched_settings.workers = atoi(argv[++i]);
+                        tasks = 1;
+                }
+                else if(0 == strcmp(argv[i], "--slice") && i + 1 < argc) {
+                        sched_settings.slice = atoll(argv[++i]);
+                        if(sched_settings.slice <= 0) {
+                                fprintf(stderr, "Invalid slice: %s\n", argv[i]);
+                                return 1;
+                        }
+                        tasks = 1;
+                }
+                else if(0 == strcmp(argv[i], "--threads") && i + 1 < argc) {
+                        set_parallel_threads(atoi(argv[++i]));
+                }
+                else if((segment = find_size_option(argv[i])) >= 0 && i + 1 < argc) {
+                        sizes[segment] = parse_size(argv[++i]);
+                        if(!sizes[segment]) {
+                                fprintf(stderr, "Invalid size for %s: %s\n",
+                                        size_options[segment], argv[i]);
+                                return 1;
+                        }
+                }
+                else if('-' == argv[i][0]) {
+                        usage();
+                        return 1;
+                }
+                else {
+                        programs[program_count++] = argv[i];
+                }
+        }
+
+        if(tasks) {
+                if(0 == program_count || profile || legacy_loader
+                                || IO_INTERACTIVE != mode) {
+                        fprintf(stderr, "--tasks needs program files and cannot be "
+                                "combined with --profile, --legacy-loader or I/O modes\n");
+                        return 1;
+                }
+
+                return run_tasks(programs, program_count, sizes,
+                        &sched_settings, load_only);
+        }
+
+        if(program_count > 1) {
+                usage();
+                return 1;
+        }
+        file_name = programs[0];
+
+        batch_io = (IO_INTERACTIVE != mode);
+        set_io_mode(mode);
+
+        /*    stdout   ,
+                . */
+        if(!batch_io) {
+                printf("Reading input from %s\n", file_name ? file_name : "stdin");
+        }
+
+        if(legacy_loader) {
+                if(0 != legacy_load(file_name, batch_io)) {
+                        return 1;
+                }
+        }
+        else if(0 != load_program(file_name)) {
+                return 1;
+        }
+
+        if(0 != apply_sizes(sizes)) {
+                return 1;
+        }
+
+        if(profile && 0 != set_profile(&profile_settings)) {
+                return 1;
+        }
+
+        if(!load_only) {
+                run();
         }
                 
         return 0;
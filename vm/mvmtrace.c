@@ -0,0 +1,126 @@
+/* mvmtrace -   ,  mvm_trace.
+ *
+ * : mvmtrace [-n count] [file]
+ *        mvm.trace. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "trace.h"
+
+void usage()
+{
+        fprintf(stderr, "Usage: mvmtrace [-n count] [file]\n\n"
+                "  -n count  print only the last count commands\n");
+}
+
+int main(int argc, char **argv)
+{
+        const char *file_name = "mvm.trace";
+        long last = -1;
+        FILE *input;
+        trace_header header;
+        char **names;
+        trace_entry entry;
+        uint64_t number;
+        uint32_t i;
+        int arg;
+
+        for(arg = 1; arg < argc; ++arg) {
+                if(0 == strcmp(argv[arg], "-n") && arg + 1 < argc) {
+                        last = atol(argv[++arg]);
+                }
+                else if('-' == argv[arg][0]) {
+                        usage();
+                        return 1;
+                }
+                else {
+                        file_name = argv[arg];
+                }
+        }
+
+        input = fopen(file_name, "rb");
+        if(NULL == input) {
+                perror(file_name);
+                return 1;
+        }
+
+        if(fread(&header, sizeof(header), 1, input) != 1
+                        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))) {
+                fprintf(stderr, "%s: not a trace file\n", file_name);
+                return 1;
+        }
+
+        if(header.version != TRACE_VERSION) {
+                fprintf(stderr, "%s: unsupported trace version %u\n",
+                        file_name, header.version);
+                return 1;
+        }
+
+        names = calloc(header.opcodes, sizeof(char *));
+        for(i = 0; i < header.opcodes; ++i) {
+                int length = fgetc(input);
+
+                if(EOF == length) {
+                        fprintf(stderr, "%s: truncated file\n", file_name);
+                        return 1;
+                }
+
+                names[i] = calloc(length + 1, 1);
+                if(fread(names[i], 1, length, input) != (size_t) length) {
+                        fprintf(stderr, "%s: truncated file\n", file_name);
+                        return 1;
+                }
+        }
+
+        switch(header.reason) {
+        case TRACE_EXIT:
+                printf("# program finished");
+                break;
+
+        case TRACE_ERROR:
+                printf("# runtime error %u", header.detail);
+                break;
+
+        case TRACE_SIGNAL:
+                printf("# signal %u", header.detail);
+                break;
+
+        default:
+                printf("# unknown reason %u", header.reason);
+        }
+
+        printf(", %u-bit words, %" PRIu64 " commands executed, last %u recorded\n",
+                header.word_bits, header.total, header.count);
+        printf("# step\taddress\tcommand\ttop of stack\n");
+
+        number = header.total - header.count;
+        for(i = 0; i < header.count; ++i, ++number) {
+                if(fread(&entry, sizeof(entry), 1, input) != 1) {
+                        fprintf(stderr, "%s: truncated file\n", file_name);
+                        return 1;
+                }
+
+                if(last >= 0 && header.count - i > (uint64_t) last)
+                        continue;
+
+                printf("%" PRIu64 "\t%u\t", number, entry.pc);
+                if(entry.opcode < header.opcodes) {
+                        printf("%s", names[entry.opcode]);
+                }
+                else {
+                        printf("(%u)", entry.opcode);
+                }
+
+                if(entry.flags & TRACE_STACK_EMPTY) {
+                        printf("\t-\n");
+                }
+                else {
+                        printf("\t%" PRId64 "\n", entry.tos);
+                }
+        }
+
+        fclose(input);
+        return 0;
+}
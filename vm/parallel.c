@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "parallel.h"
+
+void milan_error();
+void vm_run_chunk(parallel_loop *loop, vm_word *private, vm_word lo, vm_word hi);
+
+/*   :    , 
+       */
+#define CHUNKS_PER_THREAD       4
+
+unsigned int parallel_threads = 0;
+unsigned int parallel_thread_count = 0;
+
+/*     */
+pthread_mutex_t parallel_run_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*   :     ,
+   active -  ,     */
+pthread_mutex_t parallel_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t parallel_start = PTHREAD_COND_INITIALIZER;
+pthread_cond_t parallel_done = PTHREAD_COND_INITIALIZER;
+parallel_loop *parallel_current = NULL;
+unsigned long parallel_generation = 0;
+unsigned int parallel_active = 0;
+
+void set_parallel_threads(unsigned int threads)
+{
+        parallel_threads = threads;
+}
+
+/*  ,         */
+
+void parallel_chunks(parallel_loop *loop)
+{
+        vm_uword size = loop->count / loop->chunks;
+        vm_uword rest = loop->count % loop->chunks;
+        vm_uword first;
+        vm_uword length;
+        unsigned int chunk;
+
+        while(!atomic_load(&loop->failed)) {
+                chunk = atomic_fetch_add(&loop->next, 1);
+                if(chunk >= loop->chunks) {
+                        break;
+                }
+
+                /*  rest     */
+                first = chunk * size + (chunk < rest ? chunk : rest);
+                length = size + (chunk < rest ? 1 : 0);
+                vm_run_chunk(loop, loop->privates + (size_t) chunk * loop->private_size,
+                        (vm_uword) loop->from + first * (vm_uword) loop->step,
+                        (vm_uword) loop->from + (first + length - 1) * (vm_uword) loop->step);
+        }
+}
+
+void *parallel_worker(void *arg)
+{
+        unsigned long seen = 0;
+        parallel_loop *loop;
+
+        (void) arg;
+        pthread_mutex_lock(&parallel_lock);
+        for(;;) {
+                while(parallel_generation == seen) {
+                        pthread_cond_wait(&parallel_start, &parallel_lock);
+                }
+                seen = parallel_generation;
+                loop = parallel_current;
+                pthread_mutex_unlock(&parallel_lock);
+
+                parallel_chunks(loop);
+
+                pthread_mutex_lock(&parallel_lock);
+                if(0 == --parallel_active) {
+                        pthread_cond_signal(&parallel_done);
+                }
+        }
+
+        return NULL;
+}
+
+/*       */
+
+void parallel_start_threads()
+{
+        unsigned int count = parallel_threads;
+        pthread_t thread;
+        long processors;
+
+        if(parallel_thread_count) {
+                return;
+        }
+
+        if(!count) {
+                processors = sysconf(_SC_NPROCESSORS_ONLN);
+                count = processors > 0 ? processors : 1;
+        }
+
+        while(parallel_thread_count < count
+                        && 0 == pthread_create(&thread, NULL, parallel_worker, NULL)) {
+                pthread_detach(thread);
+                ++parallel_thread_count;
+        }
+
+        if(!parallel_thread_count) {
+                milan_error("Unable to create threads for PARALLEL");
+        }
+}
+
+int parallel_run(parallel_loop *loop)
+{
+        vm_uword chunks;
+
+        pthread_mutex_lock(&parallel_run_lock);
+        parallel_start_threads();
+
+        chunks = (vm_uword) parallel_thread_count * CHUNKS_PER_THREAD;
+        loop->chunks = (loop->count < chunks) ? loop->count : chunks;
+        loop->privates = calloc((size_t) loop->chunks * loop->private_size,
+                sizeof(vm_word));
+        if(!loop->privates) {
+                milan_error("Out of memory");
+        }
+        atomic_init(&loop->next, 0);
+        atomic_init(&loop->failed, 0);
+
+        pthread_mutex_lock(&parallel_lock);
+        parallel_current = loop;
+        ++parallel_generation;
+        parallel_active = parallel_thread_count;
+        pthread_cond_broadcast(&parallel_start);
+        while(parallel_active) {
+                pthread_cond_wait(&parallel_done, &parallel_lock);
+        }
+        parallel_current = NULL;
+        pthread_mutex_unlock(&parallel_lock);
+
+        pthread_mutex_unlock(&parallel_run_lock);
+        return atomic_load(&loop->failed) ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+#ifndef _MILAN_PARALLEL_H
+#define _MILAN_PARALLEL_H
+
+#include <stdatomic.h>
+#include "vm.h"
+
+/*   ( PARALLEL).
+ *
+ *     ,    .
+ *         
+ * .        ,  ,
+ *      - .   ( ,
+ *      )  
+ * : -1 -   .      .
+ *    (--tasks)   .
+ */
+
+/*   */
+typedef struct {
+        segment program;                /*     */
+        segment memory;
+        unsigned int stack_size;        /*    */
+        unsigned int loop;              /*  LOOP    */
+        vm_word from;                   /*    */
+        vm_word step;                   /*   */
+        vm_uword count;                 /*   */
+        unsigned int private_size;      /*     */
+        unsigned int chunks;            /*   */
+        vm_word *privates;              /*     */
+        atomic_uint next;               /*     */
+        atomic_int failed;              /*     */
+        int error;                      /*     , */
+        unsigned int error_address;     /*     */
+} parallel_loop;
+
+/*    (0 -   ). , 
+       . */
+
+void set_parallel_threads(unsigned int threads);
+
+/*      .
+ *
+ *  chunks  privates (   c  
+ * privates[c * private_size];   )  
+ *   .  0    1,  
+ * -     ; 
+ *     .
+ */
+
+int parallel_run(parallel_loop *loop);
+
+#endif
+
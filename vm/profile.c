@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "vm.h"
+#include "profile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*   (vm.c) */
+extern __thread command *vm_program;
+extern __thread unsigned int vm_program_size;
+extern __thread unsigned int vm_command_pointer;
+
+int vm_run_command();
+
+/*     ,  rdtsc ,   */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PROFILE_UNIT            "cycles"
+
+uint64_t profile_clock()
+{
+        return __rdtsc();
+}
+#else
+#define PROFILE_UNIT            "ns"
+
+uint64_t profile_clock()
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
+
+/* :    first  last (  ) */
+typedef struct {
+        unsigned int first;
+        unsigned int last;
+        uint64_t iterations;
+        uint64_t cycles;
+} profile_loop;
+
+profile_options profile_settings;
+int profile_on = 0;
+int profile_reported = 0;
+
+/*    */
+unsigned int profile_size = 0;
+uint64_t *profile_counts = NULL;
+uint64_t *profile_cycles = NULL;
+
+/*       (0 - ) */
+unsigned int *profile_lines = NULL;
+unsigned int profile_max_line = 0;
+
+/* ,      profile_sort() */
+const uint64_t *profile_sort_key = NULL;
+
+int set_profile(const profile_options *options)
+{
+        FILE *map;
+        unsigned int address;
+        unsigned int line;
+
+        profile_settings = *options;
+        if(profile_settings.top <= 0) {
+                profile_settings.top = 10;
+        }
+
+        profile_size = vm_program_size;
+        profile_counts = calloc(profile_size, sizeof(uint64_t));
+        profile_cycles = calloc(profile_size, sizeof(uint64_t));
+        if(!profile_counts || !profile_cycles) {
+                fprintf(stderr, "Unable to allocate memory for the profile\n");
+                return 1;
+        }
+
+        if(profile_settings.line_map) {
+                map = fopen(profile_settings.line_map, "rt");
+                profile_lines = calloc(profile_size, sizeof(unsigned int));
+                if(!map || !profile_lines) {
+                        fprintf(stderr, "Unable to read %s\n", profile_settings.line_map);
+                        if(map) {
+                                fclose(map);
+                        }
+                        return 1;
+                }
+
+                while(2 == fscanf(map, "%u %u", &address, &line)) {
+                        if(address < profile_size) {
+                                profile_lines[address] = line;
+                                if(line > profile_max_line) {
+                                        profile_max_line = line;
+                                }
+                        }
+                }
+                fclose(map);
+        }
+
+        profile_on = 1;
+        return 0;
+}
+
+int profile_enabled()
+{
+        return profile_on;
+}
+
+void profile_run()
+{
+        unsigned int address;
+        uint64_t start;
+        int running = 1;
+
+        while(running && vm_command_pointer < profile_size) {
+                address = vm_command_pointer;
+                start = profile_clock();
+                running = vm_run_command();
+                profile_cycles[address] += profile_clock() - start;
+                ++profile_counts[address];
+        }
+}
+
+/*     profile_sort_key */
+
+int profile_compare(const void *left, const void *right)
+{
+        uint64_t a = profile_sort_key[*(const unsigned int *) left];
+        uint64_t b = profile_sort_key[*(const unsigned int *) right];
+
+        return (a < b) - (a > b);
+}
+
+unsigned int *profile_sort(const uint64_t *key, unsigned int size)
+{
+        unsigned int *order = malloc(size * sizeof(unsigned int));
+        unsigned int i;
+
+        if(order) {
+                for(i = 0; i < size; ++i) {
+                        order[i] = i;
+                }
+                profile_sort_key = key;
+                qsort(order, size, sizeof(unsigned int), profile_compare);
+        }
+
+        return order;
+}
+
+double profile_percent(uint64_t part, uint64_t total)
+{
+        return total ? 100.0 * part / total : 0.0;
+}
+
+int profile_is_jump(operation op)
+{
+        return JUMP == op || JUMP_YES == op || JUMP_NO == op || LOOP == op;
+}
+
+/*     .     
+    ,      . */
+
+profile_loop *profile_find_loops(unsigned int *count)
+{
+        profile_loop *loops = malloc(profile_size * sizeof(profile_loop));
+        unsigned int address;
+        unsigned int target;
+        unsigned int i;
+
+        *count = 0;
+        if(!loops) {
+                return NULL;
+        }
+
+        for(address = 0; address < profile_size; ++address) {
+                target = vm_program[address].arg;
+                if(!profile_is_jump(vm_program[address].operation)
+                                || target > address) {
+                        continue;
+                }
+
+                for(i = 0; i < *count && loops[i].first != target; ++i) {
+                }
+                if(i == *count) {
+                        loops[i].first = target;
+                        loops[i].iterations = 0;
+                        ++*count;
+                }
+                loops[i].last = address;
+                loops[i].iterations += profile_counts[address];
+        }
+
+        for(i = 0; i < *count; ++i) {
+                loops[i].cycles = 0;
+                for(address = loops[i].first; address <= loops[i].last; ++address) {
+                        loops[i].cycles += profile_cycles[address];
+                }
+        }
+
+        return loops;
+}
+
+/*    ; 0,    */
+
+void profile_line_range(unsigned int first, unsigned int last,
+        unsigned int *low, unsigned int *high)
+{
+        unsigned int address;
+        unsigned int line;
+
+        *low = 0;
+        *high = 0;
+        for(address = first; profile_lines && address <= last; ++address) {
+                line = profile_lines[address];
+                if(line && (!*low || line < *low)) {
+                        *low = line;
+                }
+                if(line > *high) {
+                        *high = line;
+                }
+        }
+}
+
+void profile_print_opcodes(uint64_t total)
+{
+        uint64_t counts[256];
+        uint64_t cycles[256];
+        unsigned int *order;
+        unsigned int ops = 0;
+        unsigned int address;
+        unsigned int i;
+        operation op;
+
+        while(ops < 256 && operation_info((operation) ops)) {
+                ++ops;
+        }
+        memset(counts, 0, sizeof(counts));
+        memset(cycles, 0, sizeof(cycles));
+        for(address = 0; address < profile_size; ++address) {
+                op = vm_program[address].operation;
+                if((unsigned int) op < ops) {
+                        counts[op] += profile_counts[address];
+                        cycles[op] += profile_cycles[address];
+                }
+        }
+
+        order = profile_sort(cycles, ops);
+        if(!order) {
+                return;
+        }
+
+        fprintf(stderr, "\nOpcodes:\n%-12s %14s %16s %7s\n",
+                "opcode", "count", PROFILE_UNIT, "%");
+        for(i = 0; i < ops && counts[order[i]]; ++i) {
+                fprintf(stderr, "%-12s %14" PRIu64 " %16" PRIu64 " %6.2f%%\n",
+                        operation_info((operation) order[i])->name,
+                        counts[order[i]], cycles[order[i]],
+                        profile_percent(cycles[order[i]], total));
+        }
+        free(order);
+}
+
+void profile_print_lines(uint64_t total)
+{
+        uint64_t *counts = calloc(profile_max_line + 1, sizeof(uint64_t));
+        uint64_t *cycles = calloc(profile_max_line + 1, sizeof(uint64_t));
+        unsigned int *order = NULL;
+        unsigned int address;
+        int i;
+
+        if(counts && cycles) {
+                for(address = 0; address < profile_size; ++address) {
+                        counts[profile_lines[address]] += profile_counts[address];
+                        cycles[profile_lines[address]] += profile_cycles[address];
+                }
+                order = profile_sort(cycles, profile_max_line + 1);
+        }
+
+        if(order) {
+                fprintf(stderr, "\nHot lines:\n%-12s %14s %16s %7s\n",
+                        "line", "instructions", PROFILE_UNIT, "%");
+                for(i = 0; i < profile_settings.top
+                                && i <= (int) profile_max_line && counts[order[i]]; ++i) {
+                        if(order[i]) {
+                                fprintf(stderr, "%-12u", order[i]);
+                        }
+                        else {
+                                fprintf(stderr, "%-12s", "?");
+                        }
+                        fprintf(stderr, " %14" PRIu64 " %16" PRIu64 " %6.2f%%\n",
+                                counts[order[i]], cycles[order[i]],
+                                profile_percent(cycles[order[i]], total));
+                }
+        }
+
+        free(order);
+        free(counts);
+        free(cycles);
+}
+
+void profile_print_addresses(uint64_t total)
+{
+        unsigned int *order = profile_sort(profile_cycles, profile_size);
+        opcode_info *info;
+        int i;
+
+        if(!order) {
+                return;
+        }
+
+        fprintf(stderr, "\nHot addresses:\n%-12s %-10s %14s %16s %7s\n",
+                "address", "command", "count", PROFILE_UNIT, "%");
+        for(i = 0; i < profile_settings.top && i < (int) profile_size
+                        && profile_counts[order[i]]; ++i) {
+                info = operation_info(vm_program[order[i]].operation);
+                fprintf(stderr, "%-12u %-10s %14" PRIu64 " %16" PRIu64 " %6.2f%%\n",
+                        order[i], info ? info->name : "?",
+                        profile_counts[order[i]], profile_cycles[order[i]],
+                        profile_percent(profile_cycles[order[i]], total));
+        }
+        free(order);
+}
+
+void profile_print_loops(profile_loop *loops, unsigned int count, uint64_t total)
+{
+        uint64_t *cycles = malloc((count + 1) * sizeof(uint64_t));
+        unsigned int *order;
+        unsigned int low;
+        unsigned int high;
+        char where[64];
+        unsigned int i;
+
+        if(!cycles) {
+                return;
+        }
+        for(i = 0; i < count; ++i) {
+                cycles[i] = loops[i].cycles;
+        }
+
+        order = profile_sort(cycles, count);
+        if(order && count > 0) {
+                fprintf(stderr, "\nLoops:\n%-24s %14s %16s %7s\n",
+                        "loop", "iterations", PROFILE_UNIT, "%");
+                for(i = 0; i < count && i < (unsigned int) profile_settings.top
+                                && loops[order[i]].cycles; ++i) {
+                        profile_line_range(loops[order[i]].first, loops[order[i]].last,
+                                &low, &high);
+                        if(low) {
+                                snprintf(where, sizeof(where), "lines %u-%u", low, high);
+                        }
+                        else {
+                                snprintf(where, sizeof(where), "addresses %u-%u",
+                                        loops[order[i]].first, loops[order[i]].last);
+                        }
+                        fprintf(stderr, "%-24s %14" PRIu64 " %16" PRIu64 " %6.2f%%\n",
+                                where, loops[order[i]].iterations, loops[order[i]].cycles,
+                                profile_percent(loops[order[i]].cycles, total));
+                }
+        }
+
+        free(order);
+        free(cycles);
+}
+
+/*   flamegraph: ,     
+    (   ) */
+
+void profile_stack(char *stack, size_t size, unsigned int address,
+        profile_loop *loops, unsigned int count)
+{
+        unsigned int used;
+        unsigned int low;
+        unsigned int high;
+        unsigned int limit = UINT_MAX;
+        unsigned int i;
+        unsigned int best;
+        opcode_info *info;
+
+        used = snprintf(stack, size, "program");
+        for(;;) {
+                /*   -     
+                      */
+                best = count;
+                for(i = 0; i < count; ++i) {
+                        if(loops[i].first <= address && address <= loops[i].last
+                                        && loops[i].last - loops[i].first < limit
+                                        && (best == count || loops[i].last - loops[i].first
+                                                > loops[best].last - loops[best].first)) {
+                                best = i;
+                        }
+                }
+                if(best == count || used >= size) {
+                        break;
+                }
+
+                limit = loops[best].last - loops[best].first;
+                profile_line_range(loops[best].first, loops[best].last, &low, &high);
+                if(low) {
+                        used += snprintf(stack + used, size - used, ";loop at line %u", low);
+                }
+                else {
+                        used += snprintf(stack + used, size - used, ";loop at %u",
+                                loops[best].first);
+                }
+        }
+
+        if(used >= size) {
+                return;
+        }
+        if(profile_lines && profile_lines[address]) {
+                snprintf(stack + used, size - used, ";line %u", profile_lines[address]);
+        }
+        else {
+                info = operation_info(vm_program[address].operation);
+                snprintf(stack + used, size - used, ";%u %s", address,
+                        info ? info->name : "?");
+        }
+}
+
+void profile_write_folded(profile_loop *loops, unsigned int count)
+{
+        FILE *file = fopen(profile_settings.folded, "wt");
+        char stack[1024];
+        char previous[1024] = "";
+        uint64_t cycles = 0;
+        unsigned int address;
+
+        if(!file) {
+                fprintf(stderr, "Unable to write %s\n", profile_settings.folded);
+                return;
+        }
+
+        /*       */
+        for(address = 0; address < profile_size; ++address) {
+                if(!profile_counts[address]) {
+                        continue;
+                }
+
+                profile_stack(stack, sizeof(stack), address, loops, count);
+                if(strcmp(stack, previous)) {
+                        if(cycles) {
+                                fprintf(file, "%s %" PRIu64 "\n", previous, cycles);
+                        }
+                        strcpy(previous, stack);
+                        cycles = 0;
+                }
+                cycles += profile_cycles[address];
+        }
+        if(cycles) {
+                fprintf(file, "%s %" PRIu64 "\n", previous, cycles);
+        }
+
+        fclose(file);
+}
+
+void profile_report()
+{
+        profile_loop *loops;
+        unsigned int count;
+        uint64_t instructions = 0;
+        uint64_t total = 0;
+        unsigned int address;
+
+        if(!profile_on || profile_reported) {
+                return;
+        }
+        profile_reported = 1;
+
+        for(address = 0; address < profile_size; ++address) {
+                instructions += profile_counts[address];
+                total += profile_cycles[address];
+        }
+
+        fprintf(stderr, "\nProfile: %" PRIu64 " instructions, %" PRIu64 " " PROFILE_UNIT "\n",
+                instructions, total);
+        profile_print_opcodes(total);
+        if(profile_lines) {
+                profile_print_lines(total);
+        }
+        else {
+                profile_print_addresses(total);
+        }
+
+        loops = profile_find_loops(&count);
+        if(loops) {
+                profile_print_loops(loops, count, total);
+                if(profile_settings.folded) {
+                        profile_write_folded(loops, count);
+                }
+                free(loops);
+        }
+}
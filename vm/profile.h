@@ -0,0 +1,41 @@
+#ifndef _MILAN_PROFILE_H
+#define _MILAN_PROFILE_H
+
+/*  .
+ *
+ *        
+ *   (   rdtsc,  
+ *  - ).       ,
+ *      ( ,   
+ *  )    .     
+ *      .
+ */
+
+/*   */
+typedef struct {
+        const char *line_map;   /*  " " (cmilan --line-map)
+                                    NULL */
+        const char *folded;     /*   flamegraph.pl  NULL */
+        int top;                /*        */
+} profile_options;
+
+/*  .    .
+ *  0  , 1 -      .
+ */
+
+int set_profile(const profile_options *options);
+
+/*    */
+
+int profile_enabled();
+
+/*     (  run()) */
+
+void profile_run();
+
+/*    stderr     flamegraph. 
+ *    . */
+
+void profile_report();
+
+#endif
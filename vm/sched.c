@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "vm.h"
+#include "sched.h"
+
+void vm_init_segments();
+#ifdef VM_GUARD_STACK
+void vm_guard_stack();
+#endif
+
+/*      .     
+   PIPE_BUF  ,     ,
+         stdout  . */
+#define TASK_BUFFER_SIZE        4096
+
+/*    ,  */
+#define IDLE_WAIT               10
+
+typedef enum {
+        TASK_READY,             /*      */
+        TASK_DONE,              /*  */
+        TASK_FAILED             /*    */
+} task_state;
+
+typedef struct {
+        const char *name;
+        vm_context context;
+        io_stream input;
+        io_stream output;
+        char input_buffer[TASK_BUFFER_SIZE];
+        char output_buffer[TASK_BUFFER_SIZE];
+        task_state state;
+        uint64_t cpu_time;      /*  ,  */
+        unsigned long slices;   /*   */
+        unsigned long waits;    /*   */
+        unsigned long steals;   /*      */
+} task;
+
+/*  :         ,
+          */
+typedef struct {
+        pthread_mutex_t lock;
+        task **items;
+        unsigned int head;
+        unsigned int count;
+        pthread_t thread;
+        unsigned int index;
+        struct pollfd *fds;     /*    */
+        task **polled;
+} worker;
+
+task **sched_tasks = NULL;
+unsigned int sched_task_count = 0;
+unsigned int sched_task_capacity = 0;
+
+worker *sched_workers = NULL;
+unsigned int sched_worker_count = 0;
+long long sched_slice = DEFAULT_SLICE;
+
+/*    */
+atomic_uint sched_live;
+
+/* ,  .      . */
+pthread_mutex_t sched_blocked_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t sched_poll_lock = PTHREAD_MUTEX_INITIALIZER;
+task **sched_blocked = NULL;
+atomic_uint sched_blocked_count = 0;
+
+int sched_add(const char *name, const char *input, const char *output)
+{
+        task *t;
+        int fd;
+
+        if(sched_task_count == sched_task_capacity) {
+                sched_task_capacity = sched_task_capacity ? 2 * sched_task_capacity : 16;
+                sched_tasks = realloc(sched_tasks, sched_task_capacity * sizeof(task *));
+                if(!sched_tasks) {
+                        fprintf(stderr, "Out of memory\n");
+                        return 1;
+                }
+        }
+
+        t = calloc(1, sizeof(task));
+        if(!t) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+        }
+        t->name = name;
+
+        if(!input || !*input) {
+                input = "/dev/null";
+        }
+        fd = open(input, O_RDONLY | O_NONBLOCK);
+        if(fd < 0) {
+                fprintf(stderr, "Unable to read %s: %s\n", input, strerror(errno));
+                free(t);
+                return 1;
+        }
+        t->input.fd = fd;
+        t->input.data = t->input_buffer;
+        t->input.capacity = TASK_BUFFER_SIZE;
+        t->input.line = 1;
+        t->input.nonblocking = 1;
+
+        if(output && *output) {
+                fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if(fd < 0) {
+                        fprintf(stderr, "Unable to write %s: %s\n", output,
+                                strerror(errno));
+                        close(t->input.fd);
+                        free(t);
+                        return 1;
+                }
+        }
+        else {
+                fd = STDOUT_FILENO;
+        }
+        t->output.fd = fd;
+        t->output.data = t->output_buffer;
+        t->output.capacity = TASK_BUFFER_SIZE;
+
+        vm_init_segments();
+        vm_save_context(&t->context);
+        t->context.command_pointer = 0;
+        t->context.stack_pointer = 0;
+        t->context.input = &t->input;
+        t->context.output = &t->output;
+
+        sched_tasks[sched_task_count++] = t;
+        return 0;
+}
+
+void queue_push(worker *w, task *t)
+{
+        pthread_mutex_lock(&w->lock);
+        w->items[(w->head + w->count) % sched_task_count] = t;
+        ++w->count;
+        pthread_mutex_unlock(&w->lock);
+}
+
+task *queue_pop(worker *w)
+{
+        task *t = NULL;
+
+        pthread_mutex_lock(&w->lock);
+        if(w->count > 0) {
+                t = w->items[w->head];
+                w->head = (w->head + 1) % sched_task_count;
+                --w->count;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        return t;
+}
+
+task *queue_steal(worker *w)
+{
+        task *t = NULL;
+
+        if(pthread_mutex_trylock(&w->lock)) {
+                return NULL;
+        }
+        if(w->count > 0) {
+                --w->count;
+                t = w->items[(w->head + w->count) % sched_task_count];
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        return t;
+}
+
+/*      ,    */
+
+task *sched_steal(worker *self)
+{
+        unsigned int i;
+        task *t;
+
+        for(i = 1; i < sched_worker_count; ++i) {
+                t = queue_steal(&sched_workers[(self->index + i) % sched_worker_count]);
+                if(t) {
+                        ++t->steals;
+                        return t;
+                }
+        }
+
+        return NULL;
+}
+
+void sched_block(task *t)
+{
+        pthread_mutex_lock(&sched_blocked_lock);
+        sched_blocked[sched_blocked_count++] = t;
+        pthread_mutex_unlock(&sched_blocked_lock);
+}
+
+/*  ,  : ,    
+    ,    . timeout - 
+      .  0,   
+     . */
+
+int sched_poll(worker *self, int timeout)
+{
+        unsigned int count;
+        unsigned int i;
+        unsigned int j;
+
+        if(pthread_mutex_trylock(&sched_poll_lock)) {
+                return 0;
+        }
+
+        pthread_mutex_lock(&sched_blocked_lock);
+        count = sched_blocked_count;
+        for(i = 0; i < count; ++i) {
+                self->polled[i] = sched_blocked[i];
+                self->fds[i].fd = sched_blocked[i]->input.fd;
+                self->fds[i].events = POLLIN;
+                self->fds[i].revents = 0;
+        }
+        pthread_mutex_unlock(&sched_blocked_lock);
+
+        if(0 == count) {
+                pthread_mutex_unlock(&sched_poll_lock);
+                return 0;
+        }
+
+        if(poll(self->fds, count, timeout) > 0) {
+                pthread_mutex_lock(&sched_blocked_lock);
+                for(i = 0; i < count; ++i) {
+                        if(!self->fds[i].revents) {
+                                continue;
+                        }
+
+                        /*      ,
+                               
+                           count  */
+                        for(j = 0; j < sched_blocked_count; ++j) {
+                                if(sched_blocked[j] == self->polled[i]) {
+                                        sched_blocked[j] = sched_blocked[--sched_blocked_count];
+                                        break;
+                                }
+                        }
+                        queue_push(self, self->polled[i]);
+                }
+                pthread_mutex_unlock(&sched_blocked_lock);
+        }
+
+        pthread_mutex_unlock(&sched_poll_lock);
+        return 1;
+}
+
+uint64_t sched_cpu_time()
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void sched_finish(task *t, task_state state)
+{
+        t->state = state;
+        vm_free_context(&t->context);
+
+        close(t->input.fd);
+        if(STDOUT_FILENO != t->output.fd) {
+                close(t->output.fd);
+        }
+
+        atomic_fetch_sub(&sched_live, 1);
+}
+
+void sched_execute(worker *self, task *t)
+{
+        uint64_t start;
+        vm_status status;
+
+        vm_load_context(&t->context);
+
+        start = sched_cpu_time();
+        status = vm_run_slice(sched_slice, t->name);
+        t->cpu_time += sched_cpu_time() - start;
+        ++t->slices;
+
+        vm_save_context(&t->context);
+        vm_new_context();
+
+        switch(status) {
+        case VM_YIELD:
+                queue_push(self, t);
+                break;
+
+        case VM_BLOCKED:
+                ++t->waits;
+                sched_block(t);
+                break;
+
+        case VM_STOPPED:
+                sched_finish(t, TASK_DONE);
+                break;
+
+        default:
+                sched_finish(t, TASK_FAILED);
+        }
+}
+
+void *sched_worker(void *arg)
+{
+        worker *self = arg;
+        struct timespec pause = {0, IDLE_WAIT * 1000000L};
+        task *t;
+
+        while(atomic_load(&sched_live) > 0) {
+                t = queue_pop(self);
+                if(!t) {
+                        t = sched_steal(self);
+                }
+
+                if(t) {
+                        sched_execute(self, t);
+
+                        /*        */
+                        if(sched_blocked_count > 0) {
+                                sched_poll(self, 0);
+                        }
+                }
+                else if(!sched_poll(self, IDLE_WAIT)) {
+                        nanosleep(&pause, NULL);
+                }
+        }
+
+        return NULL;
+}
+
+void sched_report()
+{
+        static const char *states[] = {"running", "done", "failed"};
+        unsigned int i;
+        task *t;
+
+        fprintf(stderr, "\n%-24s %-8s %10s %8s %8s %8s\n",
+                "Program", "Status", "CPU, ms", "Slices", "Waits", "Steals");
+        for(i = 0; i < sched_task_count; ++i) {
+                t = sched_tasks[i];
+                fprintf(stderr, "%-24s %-8s %10.2f %8lu %8lu %8lu\n", t->name,
+                        states[t->state], t->cpu_time / 1e6, t->slices,
+                        t->waits, t->steals);
+        }
+}
+
+int sched_run(const sched_options *options)
+{
+        unsigned int i;
+        unsigned int started;
+        int failed = 0;
+        long processors;
+
+        if(0 == sched_task_count) {
+                return 0;
+        }
+
+        sched_slice = options->slice > 0 ? options->slice : DEFAULT_SLICE;
+        sched_worker_count = options->workers;
+        if(0 == sched_worker_count) {
+                processors = sysconf(_SC_NPROCESSORS_ONLN);
+                sched_worker_count = processors > 0 ? processors : 1;
+        }
+        if(sched_worker_count > sched_task_count) {
+                sched_worker_count = sched_task_count;
+        }
+
+#ifdef VM_GUARD_STACK
+        vm_guard_stack();
+#endif
+
+        sched_blocked = calloc(sched_task_count, sizeof(task *));
+        sched_workers = calloc(sched_worker_count, sizeof(worker));
+        if(!sched_blocked || !sched_workers) {
+                fprintf(stderr, "Out of memory\n");
+                return sched_task_count;
+        }
+
+        for(i = 0; i < sched_worker_count; ++i) {
+                worker *w = &sched_workers[i];
+
+                pthread_mutex_init(&w->lock, NULL);
+                w->index = i;
+                w->items = calloc(sched_task_count, sizeof(task *));
+                w->fds = calloc(sched_task_count, sizeof(struct pollfd));
+                w->polled = calloc(sched_task_count, sizeof(task *));
+                if(!w->items || !w->fds || !w->polled) {
+                        fprintf(stderr, "Out of memory\n");
+                        return sched_task_count;
+                }
+        }
+
+        /*     */
+        for(i = 0; i < sched_task_count; ++i) {
+                queue_push(&sched_workers[i % sched_worker_count], sched_tasks[i]);
+        }
+        atomic_store(&sched_live, sched_task_count);
+
+        /*    - .  ,  
+            ,  . */
+        for(started = 1; started < sched_worker_count; ++started) {
+                if(pthread_create(&sched_workers[started].thread, NULL, sched_worker,
+                                &sched_workers[started])) {
+                        fprintf(stderr, "Unable to start worker thread\n");
+                        break;
+                }
+        }
+        sched_worker(&sched_workers[0]);
+        for(i = 1; i < started; ++i) {
+                pthread_join(sched_workers[i].thread, NULL);
+        }
+
+        sched_report();
+
+        for(i = 0; i < sched_task_count; ++i) {
+                if(TASK_FAILED == sched_tasks[i]->state) {
+                        ++failed;
+                }
+        }
+
+        return failed;
+}
@@ -0,0 +1,41 @@
+#ifndef _MILAN_SCHED_H
+#define _MILAN_SCHED_H
+
+/*    .
+ *
+ *    (. vm_run_slice)   .
+ *       ; ,  
+ *  ,      .
+ * ,  ,   :  ,
+ *        .   
+ *    .
+ */
+
+typedef struct {
+        unsigned int workers;   /*   (0 -   ) */
+        long long slice;        /*    */
+} sched_options;
+
+/*    */
+#define DEFAULT_SLICE           10000
+
+/*  ,     (. vm_new_context).
+ *
+ * INPUT    input (NULL  "" - /dev/null), PRINT 
+ *   output (NULL  "" - stdout).  0  ,  
+ *   stderr   1.
+ */
+
+int sched_add(const char *name, const char *input, const char *output);
+
+/*       .
+ *
+ *    stderr  : , 
+ * ,  ,       
+ *   .   , 
+ *  .
+ */
+
+int sched_run(const sched_options *options);
+
+#endif
@@ -0,0 +1,134 @@
+#ifdef VM_TRACE
+
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "vm.h"
+#include "trace.h"
+
+extern int opcodes_table_size;
+
+trace_entry trace_ring[VM_TRACE_SIZE];
+uint64_t trace_total = 0;
+__thread int trace_thread = 0;
+
+const char *trace_file = "mvm.trace";
+
+/*   :   (,   
+    )    */
+volatile sig_atomic_t trace_dumped = 0;
+
+void set_trace_file(const char *file_name)
+{
+        trace_file = file_name;
+}
+
+int trace_write(int fd, const void *data, size_t size)
+{
+        const char *p = data;
+
+        while(size > 0) {
+                ssize_t n = write(fd, p, size);
+                if(n <= 0)
+                        return 0;
+
+                p += n;
+                size -= n;
+        }
+
+        return 1;
+}
+
+void trace_dump(trace_reason reason, int detail)
+{
+        trace_header header;
+        uint64_t total = trace_total;
+        uint32_t count = total < VM_TRACE_SIZE ? (uint32_t) total : VM_TRACE_SIZE;
+        uint32_t first = (uint32_t) ((total - count) & (VM_TRACE_SIZE - 1));
+        int fd;
+        int op;
+
+        if(trace_dumped)
+                return;
+        trace_dumped = 1;
+
+        fd = open(trace_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+                return;
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.word_bits = VM_WORD_BITS;
+        header.reason = reason;
+        header.detail = detail;
+        header.total = total;
+        header.count = count;
+        header.opcodes = opcodes_table_size;
+
+        if(!trace_write(fd, &header, sizeof(header))) {
+                close(fd);
+                return;
+        }
+
+        /*  :        */
+        for(op = 0; op < opcodes_table_size; ++op) {
+                const char *name = operation_info((operation) op)->name;
+                unsigned char length = (unsigned char) strlen(name);
+
+                if(!trace_write(fd, &length, 1) || !trace_write(fd, name, length)) {
+                        close(fd);
+                        return;
+                }
+        }
+
+        /*    "":  ,   */
+        if(first + count > VM_TRACE_SIZE) {
+                trace_write(fd, &trace_ring[first],
+                        (VM_TRACE_SIZE - first) * sizeof(trace_entry));
+                trace_write(fd, &trace_ring[0],
+                        (first + count - VM_TRACE_SIZE) * sizeof(trace_entry));
+        }
+        else {
+                trace_write(fd, &trace_ring[first], count * sizeof(trace_entry));
+        }
+
+        close(fd);
+}
+
+void trace_signal(int number)
+{
+        trace_dump(TRACE_SIGNAL, number);
+
+        /*   ,       */
+        signal(number, SIG_DFL);
+        raise(number);
+}
+
+void trace_start()
+{
+        static const int signals[] = {
+                SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGABRT, SIGFPE, SIGBUS,
+#ifndef VM_GUARD_STACK
+                /*    SIGSEGV  vm_stack_fault() */
+                SIGSEGV,
+#endif
+        };
+        struct sigaction action;
+        size_t i;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = trace_signal;
+        sigemptyset(&action.sa_mask);
+
+        for(i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) {
+                sigaction(signals[i], &action, NULL);
+        }
+
+        trace_total = 0;
+        trace_dumped = 0;
+        trace_thread = 1;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _MILAN_TRACE_H
+#define _MILAN_TRACE_H
+
+/*  .
+ *
+ *    -DVM_TRACE (make mvm_trace).  
+ *        ,  
+ *   ;      -,  .
+ *       ,  
+ *      .   mvmtrace.
+ *
+ *     ,    , 
+ * trace_start() (  ). , 
+ *  PARALLEL   ,    .
+ *
+ *   (    ,  ):
+ *   trace_header;
+ *      :   (1 )  ;
+ *    trace_entry      .
+ */
+
+#include <stdint.h>
+
+/*     ( ) */
+#ifndef VM_TRACE_SIZE
+#define VM_TRACE_SIZE           65536
+#endif
+
+#define TRACE_MAGIC             "MVMTRACE"
+#define TRACE_VERSION           1
+
+/*    */
+typedef enum {
+        TRACE_EXIT,             /*   */
+        TRACE_ERROR,            /*    (  detail) */
+        TRACE_SIGNAL            /*  (  detail) */
+} trace_reason;
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t word_bits;     /*    */
+        uint32_t reason;
+        uint32_t detail;
+        uint64_t total;         /*     */
+        uint32_t count;         /*     */
+        uint32_t opcodes;       /*      */
+} trace_header;
+
+/*   */
+#define TRACE_STACK_EMPTY       1
+
+typedef struct {
+        uint32_t pc;            /*   */
+        uint16_t opcode;        /*   */
+        uint16_t flags;         /* TRACE_STACK_EMPTY:    */
+        int64_t tos;            /*     */
+} trace_entry;
+
+#ifdef VM_TRACE
+
+extern trace_entry trace_ring[VM_TRACE_SIZE];
+extern uint64_t trace_total;
+
+/*   ( trace_start()) */
+extern __thread int trace_thread;
+
+/*    ;       */
+#define TRACE_RECORD(pc_, opcode_, depth_, top_) do { \
+                if(trace_thread) { \
+                        trace_entry *entry_ = &trace_ring[trace_total++ & (VM_TRACE_SIZE - 1)]; \
+                        entry_->pc = (pc_); \
+                        entry_->opcode = (opcode_); \
+                        entry_->flags = (depth_) ? 0 : TRACE_STACK_EMPTY; \
+                        entry_->tos = (depth_) ? (top_) : 0; \
+                } \
+        } while(0)
+
+/*    (  mvm.trace) */
+
+void set_trace_file(const char *file_name);
+
+/*   ,  .  
+ *  . */
+
+void trace_start();
+
+/*    .   open, write  close, 
+ *     . */
+
+void trace_dump(trace_reason reason, int detail);
+
+#endif
+
+#endif
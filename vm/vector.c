@@ -0,0 +1,306 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "vector.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(VM_SCALAR_VECTORS)
+#define VECTOR_X86
+#include <immintrin.h>
+#endif
+
+/*       */
+typedef enum {
+        KERNELS_UNKNOWN = 0,    /*    */
+        KERNELS_SCALAR,
+        KERNELS_SSE2,
+        KERNELS_AVX2
+} vector_level;
+
+atomic_int vector_level_detected = KERNELS_UNKNOWN;
+
+/*      .   
+     ,     . */
+
+vector_level vector_detect()
+{
+        int level = atomic_load_explicit(&vector_level_detected,
+                                         memory_order_relaxed);
+
+        if(KERNELS_UNKNOWN == level) {
+                level = KERNELS_SCALAR;
+#ifdef VECTOR_X86
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2")) {
+                        level = KERNELS_AVX2;
+                }
+                else if(__builtin_cpu_supports("sse2")) {
+                        level = KERNELS_SSE2;
+                }
+#endif
+                atomic_store_explicit(&vector_level_detected, level,
+                                      memory_order_relaxed);
+        }
+
+        return (vector_level) level;
+}
+
+/*  :     ,
+         */
+
+int vector_overlaps(const vm_word *result, const vm_word *a, size_t length)
+{
+        return result != a && result < a + length && a < result + length;
+}
+
+/*  .  ,  
+      ,    . */
+
+void vector_add_scalar(vm_word *result, const vm_word *a, const vm_word *b,
+                       size_t length)
+{
+        size_t i;
+
+        for(i = 0; i < length; ++i) {
+                result[i] = (vm_uword) a[i] + (vm_uword) b[i];
+        }
+}
+
+void vector_mul_scalar(vm_word *result, const vm_word *a, const vm_word *b,
+                       size_t length)
+{
+        size_t i;
+
+        for(i = 0; i < length; ++i) {
+                result[i] = (vm_uword) a[i] * (vm_uword) b[i];
+        }
+}
+
+vm_uword vector_sum_scalar(const vm_word *a, size_t length)
+{
+        vm_uword sum = 0;
+        size_t i;
+
+        for(i = 0; i < length; ++i) {
+                sum += (vm_uword) a[i];
+        }
+
+        return sum;
+}
+
+void vector_fill_scalar(vm_word *result, vm_word value, size_t length)
+{
+        size_t i;
+
+        for(i = 0; i < length; ++i) {
+                result[i] = value;
+        }
+}
+
+#ifdef VECTOR_X86
+
+/*       .  64-
+     AVX2 ,   mvm64 VMUL  . */
+#if VM_WORD_BITS == 64
+#define AVX2_ADD(x, y)          _mm256_add_epi64(x, y)
+#define AVX2_SET1(x)            _mm256_set1_epi64x(x)
+#define SSE2_ADD(x, y)          _mm_add_epi64(x, y)
+#define SSE2_SET1(x)            _mm_set1_epi64x(x)
+#else
+#define AVX2_ADD(x, y)          _mm256_add_epi32(x, y)
+#define AVX2_MUL(x, y)          _mm256_mullo_epi32(x, y)
+#define AVX2_SET1(x)            _mm256_set1_epi32(x)
+#define SSE2_ADD(x, y)          _mm_add_epi32(x, y)
+#define SSE2_SET1(x)            _mm_set1_epi32(x)
+#endif
+
+/*     */
+#define AVX2_WORDS              (sizeof(__m256i) / sizeof(vm_word))
+#define SSE2_WORDS              (sizeof(__m128i) / sizeof(vm_word))
+
+__attribute__((target("avx2")))
+void vector_add_avx2(vm_word *result, const vm_word *a, const vm_word *b,
+                     size_t length)
+{
+        size_t i;
+
+        for(i = 0; i + AVX2_WORDS <= length; i += AVX2_WORDS) {
+                __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+                _mm256_storeu_si256((__m256i *) (result + i), AVX2_ADD(x, y));
+        }
+        vector_add_scalar(result + i, a + i, b + i, length - i);
+}
+
+#ifdef AVX2_MUL
+__attribute__((target("avx2")))
+void vector_mul_avx2(vm_word *result, const vm_word *a, const vm_word *b,
+                     size_t length)
+{
+        size_t i;
+
+        for(i = 0; i + AVX2_WORDS <= length; i += AVX2_WORDS) {
+                __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+                _mm256_storeu_si256((__m256i *) (result + i), AVX2_MUL(x, y));
+        }
+        vector_mul_scalar(result + i, a + i, b + i, length - i);
+}
+#endif
+
+__attribute__((target("avx2")))
+vm_uword vector_sum_avx2(const vm_word *a, size_t length)
+{
+        __m256i sum = _mm256_setzero_si256();
+        vm_word lanes[AVX2_WORDS];
+        vm_uword total;
+        size_t i;
+
+        for(i = 0; i + AVX2_WORDS <= length; i += AVX2_WORDS) {
+                sum = AVX2_ADD(sum,
+                        _mm256_loadu_si256((const __m256i *) (a + i)));
+        }
+        _mm256_storeu_si256((__m256i *) lanes, sum);
+
+        total = vector_sum_scalar(a + i, length - i);
+        return total + vector_sum_scalar(lanes, AVX2_WORDS);
+}
+
+__attribute__((target("avx2")))
+void vector_fill_avx2(vm_word *result, vm_word value, size_t length)
+{
+        __m256i x = AVX2_SET1(value);
+        size_t i;
+
+        for(i = 0; i + AVX2_WORDS <= length; i += AVX2_WORDS) {
+                _mm256_storeu_si256((__m256i *) (result + i), x);
+        }
+        vector_fill_scalar(result + i, value, length - i);
+}
+
+__attribute__((target("sse2")))
+void vector_add_sse2(vm_word *result, const vm_word *a, const vm_word *b,
+                     size_t length)
+{
+        size_t i;
+
+        for(i = 0; i + SSE2_WORDS <= length; i += SSE2_WORDS) {
+                __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+                __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+                _mm_storeu_si128((__m128i *) (result + i), SSE2_ADD(x, y));
+        }
+        vector_add_scalar(result + i, a + i, b + i, length - i);
+}
+
+__attribute__((target("sse2")))
+vm_uword vector_sum_sse2(const vm_word *a, size_t length)
+{
+        __m128i sum = _mm_setzero_si128();
+        vm_word lanes[SSE2_WORDS];
+        vm_uword total;
+        size_t i;
+
+        for(i = 0; i + SSE2_WORDS <= length; i += SSE2_WORDS) {
+                sum = SSE2_ADD(sum, _mm_loadu_si128((const __m128i *) (a + i)));
+        }
+        _mm_storeu_si128((__m128i *) lanes, sum);
+
+        total = vector_sum_scalar(a + i, length - i);
+        return total + vector_sum_scalar(lanes, SSE2_WORDS);
+}
+
+__attribute__((target("sse2")))
+void vector_fill_sse2(vm_word *result, vm_word value, size_t length)
+{
+        __m128i x = SSE2_SET1(value);
+        size_t i;
+
+        for(i = 0; i + SSE2_WORDS <= length; i += SSE2_WORDS) {
+                _mm_storeu_si128((__m128i *) (result + i), x);
+        }
+        vector_fill_scalar(result + i, value, length - i);
+}
+
+#endif
+
+void vector_add(vm_word *result, const vm_word *a, const vm_word *b,
+                size_t length)
+{
+        if(vector_overlaps(result, a, length)
+           || vector_overlaps(result, b, length)) {
+                vector_add_scalar(result, a, b, length);
+                return;
+        }
+
+        switch(vector_detect()) {
+#ifdef VECTOR_X86
+        case KERNELS_AVX2:
+                vector_add_avx2(result, a, b, length);
+                break;
+        case KERNELS_SSE2:
+                vector_add_sse2(result, a, b, length);
+                break;
+#endif
+        default:
+                vector_add_scalar(result, a, b, length);
+                break;
+        }
+}
+
+void vector_mul(vm_word *result, const vm_word *a, const vm_word *b,
+                size_t length)
+{
+        if(vector_overlaps(result, a, length)
+           || vector_overlaps(result, b, length)) {
+                vector_mul_scalar(result, a, b, length);
+                return;
+        }
+
+        /*  SSE2  32-    
+              (   SSE4.1) */
+        switch(vector_detect()) {
+#ifdef AVX2_MUL
+        case KERNELS_AVX2:
+                vector_mul_avx2(result, a, b, length);
+                break;
+#endif
+        default:
+                vector_mul_scalar(result, a, b, length);
+                break;
+        }
+}
+
+vm_word vector_sum(const vm_word *a, size_t length)
+{
+        switch(vector_detect()) {
+#ifdef VECTOR_X86
+        case KERNELS_AVX2:
+                return vector_sum_avx2(a, length);
+        case KERNELS_SSE2:
+                return vector_sum_sse2(a, length);
+#endif
+        default:
+                return vector_sum_scalar(a, length);
+        }
+}
+
+void vector_fill(vm_word *result, vm_word value, size_t length)
+{
+        switch(vector_detect()) {
+#ifdef VECTOR_X86
+        case KERNELS_AVX2:
+                vector_fill_avx2(result, value, length);
+                break;
+        case KERNELS_SSE2:
+                vector_fill_sse2(result, value, length);
+                break;
+#endif
+        default:
+                vector_fill_scalar(result, value, length);
+                break;
+        }
+}
+
+void vector_copy(vm_word *result, const vm_word *a, size_t length)
+{
+        /* memmove       */
+        memmove(result, a, length * sizeof(vm_word));
+}
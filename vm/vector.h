@@ -0,0 +1,41 @@
+#ifndef _MILAN_VECTOR_H
+#define _MILAN_VECTOR_H
+
+#include <stddef.h>
+#include "vm.h"
+
+/*       ( VADD, VMUL,
+ * VSUM, VFILL  VCOPY).
+ *
+ *  x86   AVX2,    ,
+ *  SSE2;       
+ * -DVM_SCALAR_VECTORS -  . ,    ADD 
+ * MULT,     2^VM_WORD_BITS.  
+ *   ;     
+ *       .
+ */
+
+/* result[i] = a[i] + b[i] */
+
+void vector_add(vm_word *result, const vm_word *a, const vm_word *b,
+                size_t length);
+
+/* result[i] = a[i] * b[i] */
+
+void vector_mul(vm_word *result, const vm_word *a, const vm_word *b,
+                size_t length);
+
+/*   a[0] .. a[length - 1] */
+
+vm_word vector_sum(const vm_word *a, size_t length);
+
+/* result[i] = value */
+
+void vector_fill(vm_word *result, vm_word value, size_t length);
+
+/*  length   a  result,    */
+
+void vector_copy(vm_word *result, const vm_word *a, size_t length);
+
+#endif
+
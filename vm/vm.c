@@ -1,16 +1,90 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/mman.h>
 #include "vm.h"
+#include "profile.h"
+#include "trace.h"
+#include "vector.h"
+#include "parallel.h"
 
 void milan_error();
 
-command vm_program[MAX_PROGRAM_SIZE];
+/*    (   , .
+   vm_run_slice) */
 
-int vm_memory[MAX_MEMORY_SIZE];
-int vm_stack[MAX_STACK_SIZE];
+__thread segment vm_segments[] = {
+        {NULL, sizeof(command), 0, 0},
+        {NULL, sizeof(vm_word), 0, 0},
+        {NULL, sizeof(vm_word), 0, 0},
+        {NULL, sizeof(unsigned int), 0, 0}
+};
+
+__thread command *vm_program = NULL;
+__thread vm_word *vm_memory = NULL;
+__thread vm_word *vm_stack = NULL;
+__thread unsigned int *vm_call_stack = NULL;
+
+__thread unsigned int vm_program_size = 0;
+__thread unsigned int vm_memory_size = 0;
+__thread unsigned int vm_stack_size = 0;
+__thread unsigned int vm_call_size = 0;
+
+__thread unsigned int vm_stack_pointer = 0;
+__thread unsigned int vm_call_pointer = 0;
+
+#ifdef VM_GUARD_STACK
+/*      .   
+    ,  push  pop   :   
+    SIGSEGV,  vm_stack_fault()   
+   STACK_OVERFLOW  STACK_EMPTY. */
+__thread vm_word *vm_stack_top = NULL;
+#endif
+
+__thread unsigned int vm_command_pointer = 0;
+
+/*      ( -1, -2, ...) 
+    ;      */
+__thread vm_word *vm_private = NULL;
+__thread unsigned int vm_private_size = 0;
+__thread parallel_loop *vm_chunk_loop = NULL;
+
+/*  :     (. vm_jump) */
+#define VM_NO_BUDGET            LLONG_MAX
+
+__thread long long vm_budget = VM_NO_BUDGET;
+
+/*      vm_run_slice  
+      */
+__thread sigjmp_buf *vm_error_jump = NULL;
+__thread const char *vm_task_name = NULL;
+
+/*    */
+size_t vm_page_size = 0;
+
+/*     - */
+#define IO_BUFFER_SIZE          65536
+
+io_mode vm_io_mode = IO_INTERACTIVE;
+
+char vm_input_buffer[IO_BUFFER_SIZE];
+char vm_output_buffer[IO_BUFFER_SIZE];
+
+io_stream vm_stdin = {STDIN_FILENO, vm_input_buffer, IO_BUFFER_SIZE, 0, 0, 1, 0, 0, ""};
+io_stream vm_stdout = {STDOUT_FILENO, vm_output_buffer, IO_BUFFER_SIZE, 0, 0, 1, 0, 0, ""};
 
-unsigned int vm_stack_pointer = 0;
-unsigned int vm_command_pointer = 0;
+/*  INPUT  PRINT   */
+__thread io_stream *vm_input = &vm_stdin;
+__thread io_stream *vm_output = &vm_stdout;
 
 opcode_info opcodes_table[] = {
         {"NOP",      0},
@@ -32,7 +106,27 @@ opcode_info opcodes_table[] = {
         {"JUMP_YES", 1},
         {"JUMP_NO",  1},
         {"INPUT",    0},
-        {"PRINT",    0}
+        {"PRINT",    0},
+        {"LOOP",     1},
+        {"CALL",     1},
+        {"RET",      0},
+        {"JUMP_TABLE", 1},
+        {"ADDI",     1},
+        {"SUBI",     1},
+        {"MULI",     1},
+        {"INC",      1},
+        {"DEC",      1},
+        {"ADDM",     1},
+        {"VADD",     0},
+        {"VMUL",     0},
+        {"VSUM",     0},
+        {"VFILL",    0},
+        {"VCOPY",    0},
+        {"PARALLEL", 1},
+        {"REDUCE",   1},
+        {"INPUT_BLOCK", 0},
+        {"PRINT_BLOCK", 0},
+        {"PRINT_STACK", 1}
 };
 
 int opcodes_table_size = sizeof(opcodes_table) / sizeof(opcode_info);
@@ -45,19 +139,249 @@ typedef enum {
         STACK_EMPTY,
         DIVISION_BY_ZERO,
         BAD_INPUT,
-        UNKNOWN_COMMAND
+        END_OF_INPUT,
+        UNKNOWN_COMMAND,
+        CALL_OVERFLOW,
+        RET_WITHOUT_CALL,
+        BAD_PARALLEL
 } runtime_error;
 
+/*  -.
+ *
+ *      stdin    
+ *   vm_input_ring,      
+ * vm_output_ring      .  
+ *      ,   
+ * .    .
+ */
+
+/*   ( ) */
+#define RING_SIZE               4096
+
+typedef struct {
+        vm_word words[RING_SIZE];
+        _Alignas(64) atomic_size_t head;  /*    */
+        _Alignas(64) atomic_size_t tail;  /*    */
+} word_ring;
+
+word_ring vm_input_ring;
+word_ring vm_output_ring;
+
+/* ,   ,  -1,    */
+atomic_int vm_input_status = -1;
+
+/*       */
+atomic_int vm_input_stop = 0;
+atomic_int vm_output_stop = 0;
+
+pthread_t vm_reader;
+pthread_t vm_writer;
+int vm_async_running = 0;
+
+/*    ,    */
+
+void vm_update_segment_pointers()
+{
+        vm_program = (command *) vm_segments[PROGRAM_SEGMENT].base;
+        vm_memory = (vm_word *) vm_segments[MEMORY_SEGMENT].base;
+        vm_stack = (vm_word *) vm_segments[STACK_SEGMENT].base;
+        vm_call_stack = (unsigned int *) vm_segments[CALL_SEGMENT].base;
+
+        vm_program_size = vm_segments[PROGRAM_SEGMENT].size;
+        vm_memory_size = vm_segments[MEMORY_SEGMENT].size;
+        vm_stack_size = vm_segments[STACK_SEGMENT].size;
+        vm_call_size = vm_segments[CALL_SEGMENT].size;
+}
+
+int set_segment_size(segment_type type, unsigned int size)
+{
+        segment *s = &vm_segments[type];
+        size_t page;
+        size_t bytes;
+        void *area;
+
+        if(!vm_page_size) {
+                vm_page_size = sysconf(_SC_PAGESIZE);
+        }
+        page = vm_page_size;
+
+#ifdef VM_GUARD_STACK
+        /*        */
+        if(STACK_SEGMENT == type) {
+                size = (size + page / s->element_size - 1)
+                        / (page / s->element_size) * (page / s->element_size);
+        }
+#endif
+
+        if(size > MAX_SEGMENT_SIZE) {
+                return 1;
+        }
+
+        if(!s->base) {
+                /*    ,   
+                         */
+                area = mmap(NULL, (size_t) MAX_SEGMENT_SIZE * s->element_size + 2 * page,
+                        PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if(MAP_FAILED == area) {
+                        return 1;
+                }
+                s->base = (char *) area + page;
+        }
+
+        bytes = ((size_t) size * s->element_size + page - 1) / page * page;
+        if(bytes > s->committed) {
+                if(mprotect(s->base + s->committed, bytes - s->committed,
+                                PROT_READ | PROT_WRITE)) {
+                        return 1;
+                }
+        }
+        else if(bytes < s->committed) {
+                /*        */
+                if(MAP_FAILED == mmap(s->base + bytes, s->committed - bytes, PROT_NONE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                                -1, 0)) {
+                        return 1;
+                }
+        }
+        if(size < s->size) {
+                /*        */
+                memset(s->base + (size_t) size * s->element_size, 0,
+                        bytes - (size_t) size * s->element_size);
+        }
+
+        s->committed = bytes;
+        s->size = size;
+        vm_update_segment_pointers();
+        return 0;
+}
+
+unsigned int get_segment_size(segment_type type)
+{
+        return vm_segments[type].size;
+}
+
+/* ,    ,     */
+
+void vm_init_segments()
+{
+        static const unsigned int default_sizes[] = {
+                DEFAULT_PROGRAM_SIZE,
+                DEFAULT_MEMORY_SIZE,
+                DEFAULT_STACK_SIZE,
+                DEFAULT_CALL_SIZE
+        };
+        int type;
+
+        for(type = PROGRAM_SEGMENT; type <= CALL_SEGMENT; ++type) {
+                if(!vm_segments[type].base
+                                && set_segment_size(type, default_sizes[type])) {
+                        milan_error("Unable to allocate VM memory");
+                }
+        }
+}
+
+/*   ,      index: 
+   ,    .  0,  
+   . */
+
+int vm_grow_segment(segment_type type, unsigned int index)
+{
+        unsigned int size;
+
+        vm_init_segments();
+
+        size = vm_segments[type].size;
+        if(index < size) {
+                return 1;
+        }
+        if(index >= MAX_SEGMENT_SIZE) {
+                return 0;
+        }
+
+        while(size <= index) {
+                size = size ? size * 2 : 1;
+        }
+        if(size > MAX_SEGMENT_SIZE) {
+                size = MAX_SEGMENT_SIZE;
+        }
+
+        return 0 == set_segment_size(type, size);
+}
+
+#ifdef VM_GUARD_STACK
+/*  SIGSEGV:       - 
+     ,      - .
+       push  pop,  
+       . */
+
+void vm_error(runtime_error error);
+
+void vm_stack_fault(int number, siginfo_t *info, void *context)
+{
+        segment *stack = &vm_segments[STACK_SEGMENT];
+        char *address = info->si_addr;
+        char *end = stack->base + (size_t) stack->size * stack->element_size;
+
+        (void) context;
+        if(address >= stack->base - vm_page_size && address < stack->base) {
+                vm_error(STACK_EMPTY);
+        }
+        if(address >= end && address < end + vm_page_size) {
+                vm_error(STACK_OVERFLOW);
+        }
+
+        /*    :    
+             */
+#ifdef VM_TRACE
+        trace_dump(TRACE_SIGNAL, number);
+#endif
+        signal(number, SIG_DFL);
+}
+
+void vm_guard_stack()
+{
+        struct sigaction action;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = vm_stack_fault;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, NULL);
+
+        vm_stack_top = vm_stack;
+}
+#endif
+
 void vm_init()
 {
         vm_stack_pointer = 0;
+        vm_call_pointer = 0;
 	vm_command_pointer = 0;
 }
 
+void vm_flush_output();
+
 void vm_error(runtime_error error)
 {
 	opcode_info* info;
 
+        if(vm_chunk_loop) {
+                /*        */
+                if(0 == atomic_exchange(&vm_chunk_loop->failed, 1)) {
+                        vm_chunk_loop->error = error;
+                        vm_chunk_loop->error_address = vm_command_pointer;
+                }
+                siglongjmp(*vm_error_jump, 1);
+        }
+
+        /* ,    ,  
+               */
+        vm_flush_output();
+
+        if(vm_task_name) {
+                fprintf(stderr, "%s: ", vm_task_name);
+        }
+
         switch(error) {
         case BAD_DATA_ADDRESS:
                 fprintf(stderr, "Error: illegal data address\n");
@@ -84,13 +408,35 @@ void vm_error(runtime_error error)
                 break;
 
         case BAD_INPUT:
-                fprintf(stderr, "Error: illegal input\n");
+                if(vm_input->error[0]) {
+                        fprintf(stderr, "Error: illegal input at line %u: %s\n",
+                                vm_input->line, vm_input->error);
+                }
+                else {
+                        fprintf(stderr, "Error: illegal input\n");
+                }
+                break;
+
+        case END_OF_INPUT:
+                fprintf(stderr, "Error: unexpected end of input\n");
                 break;
 
         case UNKNOWN_COMMAND:
                 fprintf(stderr, "Error: unknown command, unable to execute\n");
                 break;
 
+        case CALL_OVERFLOW:
+                fprintf(stderr, "Error: call stack overflow\n");
+                break;
+
+        case RET_WITHOUT_CALL:
+                fprintf(stderr, "Error: RET without CALL\n");
+                break;
+
+        case BAD_PARALLEL:
+                fprintf(stderr, "Error: illegal PARALLEL loop\n");
+                break;
+
         default:
                 fprintf(stderr, "Error: runtime error %d\n", error);
         }
@@ -99,13 +445,13 @@ void vm_error(runtime_error error)
 
         info = operation_info(vm_program[vm_command_pointer].operation);
 	if(NULL == info) {
-		fprintf(stderr, "%d\t(%d)\t\t%d\n", vm_command_pointer, 
+		fprintf(stderr, "%d\t(%d)\t\t%" PRI_VM_WORD "\n", vm_command_pointer, 
 			vm_program[vm_command_pointer].operation,
 			vm_program[vm_command_pointer].arg);
 	}
 	else {
                 if(info->need_arg) {
-                        fprintf(stderr, "\t%d\t%s\t\t%d\n", vm_command_pointer, info->name,
+                        fprintf(stderr, "\t%d\t%s\t\t%" PRI_VM_WORD "\n", vm_command_pointer, info->name,
                                 vm_program[vm_command_pointer].arg);
                 }
                 else {
@@ -113,51 +459,532 @@ void vm_error(runtime_error error)
                 }
         }
 
+        profile_report();
+#ifdef VM_TRACE
+        trace_dump(TRACE_ERROR, error);
+#endif
+        if(vm_error_jump) {
+                /*      */
+                siglongjmp(*vm_error_jump, 1);
+        }
         milan_error("VM error");
 }
 
-int vm_load(unsigned int address)
+vm_word vm_load(vm_uword address)
 {
-        if(address < MAX_MEMORY_SIZE) {
+        if(address < vm_memory_size) {
                 return vm_memory[address];
         }
+        else if(~address < vm_private_size) {
+                /*   : -1 -  */
+                return vm_private[~address];
+        }
         else {
                 vm_error(BAD_DATA_ADDRESS);
                 return 0;
         }
 }
 
-void vm_store(unsigned int address, int word)
+void vm_store(vm_uword address, vm_word word)
 {
-        if(address < MAX_MEMORY_SIZE) {
+        if(address < vm_memory_size) {
                 vm_memory[address] = word;
         }
+        else if(~address < vm_private_size) {
+                vm_private[~address] = word;
+        }
         else {
                 vm_error(BAD_DATA_ADDRESS);
         }
 }
 
-int vm_read()
+vm_word vm_read_interactive()
 {
-        int n;
+        vm_word n;
+        int result;
 
 	fprintf(stderr, "> "); fflush(stdout);
-        if(scanf("%d", &n)) {
+        result = scanf("%" SCN_VM_WORD, &n);
+        if(1 == result) {
                 return n;
         }
+        else if(EOF == result) {
+                vm_error(END_OF_INPUT);
+                return 0;
+        }
         else {
                 vm_error(BAD_INPUT);
                 return 0;
         }
 }
 
-void vm_write(int n)
+/*      ( )  EOF,
+     .     vm_input->error. */
+
+int vm_input_peek()
+{
+        io_stream *in = vm_input;
+        ssize_t size;
+
+        if(in->position == in->size) {
+                do {
+                        size = read(in->fd, in->data, in->capacity);
+                } while(size < 0 && EINTR == errno);
+
+                if(size < 0) {
+                        snprintf(in->error, sizeof(in->error),
+                                "%s", strerror(errno));
+                }
+                if(size <= 0) {
+                        return EOF;
+                }
+
+                in->position = 0;
+                in->size = size;
+        }
+
+        return (unsigned char) in->data[in->position];
+}
+
+int vm_is_space(int c)
+{
+        return ' ' == c || '\t' == c || '\n' == c || '\r' == c
+                || '\v' == c || '\f' == c;
+}
+
+/*     stdin.  1    value
+    0     error.    , 
+    vm_error  . */
+
+int vm_parse_input(vm_word *value, runtime_error *error)
+{
+        char token[32];
+        size_t length = 0;
+        int c;
+        int negative = 0;
+        int digits = 0;
+        int overflow = 0;
+        vm_uword number = 0;
+        /*       
+             */
+        vm_uword limit;
+
+        /*   ,   */
+        while(vm_is_space(c = vm_input_peek())) {
+                if('\n' == c) {
+                        ++vm_input->line;
+                }
+                ++vm_input->position;
+        }
+
+        if(EOF == c) {
+                *error = vm_input->error[0] ? BAD_INPUT : END_OF_INPUT;
+                return 0;
+        }
+
+        if('-' == c || '+' == c) {
+                negative = ('-' == c);
+                token[length++] = c;
+                ++vm_input->position;
+        }
+
+        limit = negative ? (vm_uword) VM_WORD_MAX + 1 : VM_WORD_MAX;
+        while((c = vm_input_peek()) >= '0' && c <= '9') {
+                if(number > (limit - (c - '0')) / 10) {
+                        overflow = 1;
+                }
+                else {
+                        number = number * 10 + (c - '0');
+                }
+
+                ++digits;
+                if(length < sizeof(token) - 1) {
+                        token[length++] = c;
+                }
+                ++vm_input->position;
+        }
+
+        if(digits > 0 && !overflow && (EOF == c || vm_is_space(c))) {
+                *value = negative ? (vm_word) (0u - number) : (vm_word) number;
+                return 1;
+        }
+
+        /*       */
+        while(EOF != (c = vm_input_peek()) && !vm_is_space(c)) {
+                if(length < sizeof(token) - 1) {
+                        token[length++] = c;
+                }
+                ++vm_input->position;
+        }
+        token[length] = '\0';
+
+        snprintf(vm_input->error, sizeof(vm_input->error),
+                overflow ? "\"%s\" is out of range" : "\"%s\" is not an integer",
+                token);
+        *error = BAD_INPUT;
+        return 0;
+}
+
+vm_word vm_read_batch()
+{
+        vm_word value;
+        runtime_error error;
+
+        if(!vm_parse_input(&value, &error)) {
+                vm_error(error);
+        }
+
+        return value;
+}
+
+/*   :       (
+    ),  INPUT    .  ,
+     ;  0,    . */
+
+int vm_input_ready()
+{
+        io_stream *in = vm_input;
+        size_t i;
+        ssize_t size;
+
+        for(;;) {
+                /*  ,       */
+                for(i = in->position; i < in->size && vm_is_space(in->data[i]); ++i)
+                        ;
+                for(; i < in->size; ++i) {
+                        if(vm_is_space(in->data[i])) {
+                                return 1;
+                        }
+                }
+                if(in->eof) {
+                        return 1;
+                }
+
+                /*       */
+                memmove(in->data, in->data + in->position, in->size - in->position);
+                in->size -= in->position;
+                in->position = 0;
+                if(in->size == in->capacity) {
+                        /*   :    */
+                        return 1;
+                }
+
+                size = read(in->fd, in->data + in->size, in->capacity - in->size);
+                if(size > 0) {
+                        in->size += size;
+                }
+                else if(0 == size) {
+                        in->eof = 1;
+                }
+                else if(EAGAIN == errno || EWOULDBLOCK == errno) {
+                        return 0;
+                }
+                else if(EINTR != errno) {
+                        snprintf(in->error, sizeof(in->error), "%s", strerror(errno));
+                        in->eof = 1;
+                }
+        }
+}
+
+/*   :    , 
+    ,     . */
+
+void ring_wait(int *spins)
+{
+        struct timespec pause = {0, 50000};
+
+        if(++*spins < 64) {
+                return;
+        }
+        else if(*spins < 1024) {
+                sched_yield();
+        }
+        else {
+                nanosleep(&pause, NULL);
+        }
+}
+
+/*    .   ,  ;
+        stop,  0. */
+
+int ring_push(word_ring *ring, vm_word word, atomic_int *stop)
+{
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        int spins = 0;
+
+        while(tail - atomic_load_explicit(&ring->head, memory_order_acquire)
+                        == RING_SIZE) {
+                if(stop && atomic_load_explicit(stop, memory_order_relaxed)) {
+                        return 0;
+                }
+                ring_wait(&spins);
+        }
+
+        ring->words[tail & (RING_SIZE - 1)] = word;
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+        return 1;
+}
+
+/*      .  0,  
+   . */
+
+int ring_pop(word_ring *ring, vm_word *word)
+{
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+        if(head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+                return 0;
+        }
+
+        *word = ring->words[head & (RING_SIZE - 1)];
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        return 1;
+}
+
+void *vm_reader_thread(void *unused)
+{
+        vm_word value;
+        runtime_error error;
+
+        (void) unused;
+        while(vm_parse_input(&value, &error)) {
+                if(!ring_push(&vm_input_ring, value, &vm_input_stop)) {
+                        return NULL;
+                }
+        }
+
+        /*       */
+        atomic_store_explicit(&vm_input_status, error, memory_order_release);
+        return NULL;
+}
+
+void vm_write_batch(vm_word n);
+void vm_write_buffer();
+
+void *vm_writer_thread(void *unused)
+{
+        vm_word word;
+        int spins = 0;
+
+        (void) unused;
+        for(;;) {
+                if(ring_pop(&vm_output_ring, &word)) {
+                        vm_write_batch(word);
+                        spins = 0;
+                }
+                else if(atomic_load_explicit(&vm_output_stop, memory_order_acquire)) {
+                        /* ,     */
+                        if(!ring_pop(&vm_output_ring, &word)) {
+                                break;
+                        }
+                        vm_write_batch(word);
+                }
+                else {
+                        ring_wait(&spins);
+                }
+        }
+
+        vm_write_buffer();
+        return NULL;
+}
+
+void vm_async_start()
+{
+        if(pthread_create(&vm_reader, NULL, vm_reader_thread, NULL)) {
+                vm_io_mode = IO_BATCH;
+                return;
+        }
+
+        if(pthread_create(&vm_writer, NULL, vm_writer_thread, NULL)) {
+                pthread_cancel(vm_reader);
+                pthread_join(vm_reader, NULL);
+                vm_io_mode = IO_BATCH;
+                return;
+        }
+
+        vm_async_running = 1;
+}
+
+/*  :      read()  
+    ,   ;   
+   ,    . */
+
+void vm_async_stop()
+{
+        if(!vm_async_running) {
+                return;
+        }
+        vm_async_running = 0;
+
+        atomic_store(&vm_input_stop, 1);
+        pthread_cancel(vm_reader);
+        pthread_join(vm_reader, NULL);
+
+        atomic_store_explicit(&vm_output_stop, 1, memory_order_release);
+        pthread_join(vm_writer, NULL);
+}
+
+vm_word vm_read_async()
 {
-        fprintf(stderr, "%d\n", n);
+        vm_word word;
+        int status;
+        int spins = 0;
+
+        for(;;) {
+                if(ring_pop(&vm_input_ring, &word)) {
+                        return word;
+                }
+
+                status = atomic_load_explicit(&vm_input_status, memory_order_acquire);
+                if(status >= 0) {
+                        if(ring_pop(&vm_input_ring, &word)) {
+                                return word;
+                        }
+                        vm_error((runtime_error) status);
+                        return 0;
+                }
+
+                ring_wait(&spins);
+        }
 }
 
-int vm_pop()
+vm_word vm_read()
 {
+        if(IO_ASYNC == vm_io_mode) {
+                return vm_read_async();
+        }
+        else if(IO_BATCH == vm_io_mode) {
+                return vm_read_batch();
+        }
+        else {
+                return vm_read_interactive();
+        }
+}
+
+/*   length   words  INPUT_BLOCK.  
+     ,      .
+      . */
+
+vm_uword vm_read_block(vm_word *words, vm_uword length)
+{
+        runtime_error error;
+        vm_uword i;
+
+        if(IO_BATCH != vm_io_mode) {
+                for(i = 0; i < length; ++i) {
+                        words[i] = vm_read();
+                }
+                return length;
+        }
+
+        /*       */
+        for(i = 0; i < length; ++i) {
+                if(vm_input->nonblocking && !vm_input_ready()) {
+                        break;
+                }
+                if(!vm_parse_input(&words[i], &error)) {
+                        vm_error(error);
+                }
+        }
+        return i;
+}
+
+void vm_write_buffer()
+{
+        io_stream *out = vm_output;
+        const char *data = out->data;
+        ssize_t written;
+
+        while(out->size > 0) {
+                written = write(out->fd, data, out->size);
+                if(written < 0) {
+                        if(EINTR == errno) {
+                                continue;
+                        }
+
+                        /*    (,  ) */
+                        break;
+                }
+
+                data += written;
+                out->size -= written;
+        }
+
+        out->size = 0;
+}
+
+void vm_flush_output()
+{
+        if(vm_async_running) {
+                vm_async_stop();
+        }
+        else {
+                vm_write_buffer();
+        }
+}
+
+void vm_write_batch(vm_word n)
+{
+        io_stream *out = vm_output;
+        char digits[24];
+        int length = 0;
+        vm_uword value = (n < 0) ? 0u - (vm_uword) n : (vm_uword) n;
+
+        do {
+                digits[length++] = '0' + value % 10;
+                value /= 10;
+        } while(value);
+
+        if(out->size + length + 2 > out->capacity) {
+                vm_write_buffer();
+        }
+
+        if(n < 0) {
+                out->data[out->size++] = '-';
+        }
+        while(length > 0) {
+                out->data[out->size++] = digits[--length];
+        }
+        out->data[out->size++] = '\n';
+}
+
+void vm_write(vm_word n)
+{
+        if(IO_ASYNC == vm_io_mode) {
+                ring_push(&vm_output_ring, n, NULL);
+        }
+        else if(IO_BATCH == vm_io_mode) {
+                vm_write_batch(n);
+        }
+        else {
+                fprintf(stderr, "%" PRI_VM_WORD "\n", n);
+        }
+}
+
+/*  length   PRINT_BLOCK  PRINT_STACK */
+
+void vm_write_block(const vm_word *words, vm_uword length)
+{
+        vm_uword i;
+
+        if(IO_BATCH == vm_io_mode) {
+                for(i = 0; i < length; ++i) {
+                        vm_write_batch(words[i]);
+                }
+        }
+        else {
+                for(i = 0; i < length; ++i) {
+                        vm_write(words[i]);
+                }
+        }
+}
+
+vm_word vm_pop()
+{
+#ifdef VM_GUARD_STACK
+        /*         */
+        return *--vm_stack_top;
+#else
 	if(vm_stack_pointer > 0) {
 		return vm_stack[--vm_stack_pointer];
 	}
@@ -165,16 +992,219 @@ int vm_pop()
 		vm_error(STACK_EMPTY);
                 return 0;
 	}
+#endif
 }
 
-void vm_push(int word)
+void vm_push(vm_word word)
 {
-	if(vm_stack_pointer < MAX_STACK_SIZE) {
+#ifdef VM_GUARD_STACK
+        /*          */
+        *vm_stack_top++ = word;
+#else
+	if(vm_stack_pointer < vm_stack_size) {
 		vm_stack[vm_stack_pointer++] = word;
 	}
 	else {
 		vm_error(STACK_OVERFLOW);
 	}
+#endif
+}
+
+/*    arg   index.   
+   ,      . */
+
+int vm_jump(unsigned int index, vm_word arg)
+{
+        vm_command_pointer = arg;
+        if((vm_uword) arg <= index) {
+                vm_budget -= index - arg + 1;
+                if(vm_budget <= 0) {
+                        return VM_YIELD;
+                }
+        }
+
+        return VM_RUNNING;
+}
+
+/*    depth    (1 - )   */
+
+vm_word *vm_peek(unsigned int depth)
+{
+#ifdef VM_GUARD_STACK
+        /*  -       */
+        return vm_stack_top - depth;
+#else
+        if(vm_stack_pointer < depth) {
+                vm_error(STACK_EMPTY);
+                return vm_stack;
+        }
+
+        return &vm_stack[vm_stack_pointer - depth];
+#endif
+}
+
+/*     [base, base + length)  
+    */
+
+void vm_check_range(vm_word base, vm_word length)
+{
+        if(base < 0 || length < 0 || (vm_uword) base > vm_memory_size
+           || (vm_uword) length > vm_memory_size - (vm_uword) base) {
+                vm_error(BAD_DATA_ADDRESS);
+        }
+}
+
+/*     */
+
+unsigned int vm_stack_depth()
+{
+#ifdef VM_GUARD_STACK
+        return vm_stack_top - vm_stack;
+#else
+        return vm_stack_pointer;
+#endif
+}
+
+/*  count ,  vm_peek */
+
+void vm_drop(unsigned int count)
+{
+#ifdef VM_GUARD_STACK
+        vm_stack_top -= count;
+#else
+        vm_stack_pointer -= count;
+#endif
+}
+
+int vm_run_command();
+
+/*   lo..hi     
+   (. parallel.c).    loop. */
+
+void vm_run_chunk(parallel_loop *loop, vm_word *private, vm_word lo, vm_word hi)
+{
+        sigjmp_buf failure;
+        int status = VM_RUNNING;
+
+        /*    - ,     -  */
+        vm_segments[PROGRAM_SEGMENT] = loop->program;
+        vm_segments[MEMORY_SEGMENT] = loop->memory;
+        if(vm_segments[STACK_SEGMENT].size != loop->stack_size
+                        && set_segment_size(STACK_SEGMENT, loop->stack_size)) {
+                milan_error("Unable to allocate VM memory");
+        }
+        vm_init_segments();
+        vm_update_segment_pointers();
+
+        vm_private = private;
+        vm_private_size = loop->private_size;
+        vm_stack_pointer = 0;
+        vm_call_pointer = 0;
+#ifdef VM_GUARD_STACK
+        vm_stack_top = vm_stack;
+#endif
+
+        vm_chunk_loop = loop;
+        if(sigsetjmp(failure, 1)) {
+                vm_error_jump = NULL;
+                vm_chunk_loop = NULL;
+                return;
+        }
+        vm_error_jump = &failure;
+
+        /*   FOR:      , LOOP
+                 */
+        private[0] = (vm_uword) lo - (vm_uword) loop->step;
+        vm_push(hi);
+        vm_push(loop->step);
+        vm_push(-1);
+        vm_command_pointer = loop->loop;
+        while(VM_RUNNING == status && vm_command_pointer != loop->loop + 1) {
+                status = (vm_command_pointer < vm_program_size)
+                        ? vm_run_command() : VM_STOPPED;
+        }
+
+        vm_error_jump = NULL;
+        vm_chunk_loop = NULL;
+}
+
+/*  PARALLEL   index */
+
+int vm_parallel(unsigned int index, vm_word private_size)
+{
+        parallel_loop loop;
+        unsigned int reductions;
+        unsigned int jump;
+        unsigned int exit;
+        unsigned int chunk;
+        unsigned int i;
+        vm_word *control;
+        vm_uword total;
+
+        /*  , JUMP    LOOP    */
+        jump = index + 1;
+        while(jump < vm_program_size && REDUCE == vm_program[jump].operation) {
+                ++jump;
+        }
+        reductions = jump - index - 1;
+        if(jump >= vm_program_size || JUMP != vm_program[jump].operation
+                        || (vm_uword) vm_program[jump].arg <= jump + 1
+                        || (vm_uword) vm_program[jump].arg > vm_program_size
+                        || LOOP != vm_program[vm_program[jump].arg - 1].operation
+                        || private_size <= (vm_word) reductions
+                        || private_size > MAX_SEGMENT_SIZE
+                        || vm_chunk_loop) {
+                vm_error(BAD_PARALLEL);
+        }
+        exit = vm_program[jump].arg;
+        for(i = 0; i < reductions; ++i) {
+                vm_check_range(vm_program[index + 1 + i].arg, 1);
+        }
+
+        /*  ,    */
+        control = vm_peek(3);
+        loop.from = control[0];
+        loop.step = control[2];
+        if(0 == loop.step) {
+                vm_error(BAD_PARALLEL);
+        }
+        if(loop.step > 0) {
+                loop.count = (control[1] < control[0]) ? 0
+                        : ((vm_uword) control[1] - (vm_uword) control[0])
+                                / (vm_uword) loop.step + 1;
+        }
+        else {
+                loop.count = (control[1] > control[0]) ? 0
+                        : ((vm_uword) control[0] - (vm_uword) control[1])
+                                / (0 - (vm_uword) loop.step) + 1;
+        }
+        vm_drop(3);
+
+        if(loop.count) {
+                loop.program = vm_segments[PROGRAM_SEGMENT];
+                loop.memory = vm_segments[MEMORY_SEGMENT];
+                loop.stack_size = vm_stack_size;
+                loop.loop = exit - 1;
+                loop.private_size = private_size;
+                if(parallel_run(&loop)) {
+                        free(loop.privates);
+                        vm_command_pointer = loop.error_address;
+                        vm_error(loop.error);
+                }
+
+                /* :   -  -2, -3, ... */
+                for(i = 0; i < reductions; ++i) {
+                        total = vm_memory[vm_program[index + 1 + i].arg];
+                        for(chunk = 0; chunk < loop.chunks; ++chunk) {
+                                total += loop.privates[(size_t) chunk * private_size + 1 + i];
+                        }
+                        vm_memory[vm_program[index + 1 + i].arg] = total;
+                }
+                free(loop.privates);
+        }
+
+        vm_command_pointer = exit;
+        return VM_RUNNING;
 }
 
 int vm_run_command()
@@ -182,8 +1212,18 @@ int vm_run_command()
 	unsigned int index = vm_command_pointer;
 
         operation op = vm_program[index].operation;
-        unsigned int arg = vm_program[index].arg;
-        int data;
+        vm_word arg = vm_program[index].arg;
+        vm_word data;
+        vm_word sum;
+        vm_word *control;
+
+#ifdef VM_TRACE
+#ifdef VM_GUARD_STACK
+        TRACE_RECORD(index, op, vm_stack_top != vm_stack, vm_stack_top[-1]);
+#else
+        TRACE_RECORD(index, op, vm_stack_pointer, vm_stack[vm_stack_pointer - 1]);
+#endif
+#endif
 
         switch(op) {
         case NOP:
@@ -191,7 +1231,7 @@ int vm_run_command()
                 break;
 
         case STOP:
-                return 0;
+                return VM_STOPPED;
                 break;
                 
         case LOAD:
@@ -244,6 +1284,88 @@ int vm_run_command()
                 vm_push(vm_pop() * data);
                 break;
 
+        /*        
+                */
+        case ADDI:
+                *vm_peek(1) += arg;
+                break;
+
+        case SUBI:
+                *vm_peek(1) -= arg;
+                break;
+
+        case MULI:
+                *vm_peek(1) *= arg;
+                break;
+
+        case ADDM:
+                data = vm_load(arg);
+                *vm_peek(1) += data;
+                break;
+
+        case INC:
+                if((vm_uword) arg < vm_memory_size) {
+                        ++vm_memory[arg];
+                }
+                else {
+                        vm_store(arg, vm_load(arg) + 1);
+                }
+                break;
+
+        case DEC:
+                if((vm_uword) arg < vm_memory_size) {
+                        --vm_memory[arg];
+                }
+                else {
+                        vm_store(arg, vm_load(arg) - 1);
+                }
+                break;
+
+        /*  :       
+              */
+        case VADD:
+        case VMUL:
+                control = vm_peek(4);
+                vm_check_range(control[0], control[3]);
+                vm_check_range(control[1], control[3]);
+                vm_check_range(control[2], control[3]);
+                if(VADD == op) {
+                        vector_add(vm_memory + control[0],
+                                   vm_memory + control[1],
+                                   vm_memory + control[2], control[3]);
+                }
+                else {
+                        vector_mul(vm_memory + control[0],
+                                   vm_memory + control[1],
+                                   vm_memory + control[2], control[3]);
+                }
+                vm_drop(4);
+                break;
+
+        case VSUM:
+                control = vm_peek(2);
+                vm_check_range(control[0], control[1]);
+                data = vector_sum(vm_memory + control[0], control[1]);
+                vm_drop(2);
+                vm_push(data);
+                break;
+
+        case VFILL:
+                control = vm_peek(3);
+                vm_check_range(control[0], control[1]);
+                vector_fill(vm_memory + control[0], control[2], control[1]);
+                vm_drop(3);
+                break;
+
+        case VCOPY:
+                control = vm_peek(3);
+                vm_check_range(control[0], control[2]);
+                vm_check_range(control[1], control[2]);
+                vector_copy(vm_memory + control[0], vm_memory + control[1],
+                            control[2]);
+                vm_drop(3);
+                break;
+
         case DIV:
                 data = vm_pop();
                 if(0 == data) {
@@ -287,9 +1409,8 @@ int vm_run_command()
                 break;
 
         case JUMP:
-                if(arg < MAX_PROGRAM_SIZE) {
-                        vm_command_pointer = arg;
-                        return 1;
+                if((vm_uword) arg < vm_program_size) {
+                        return vm_jump(index, arg);
                 }
                 else {
                         vm_error(BAD_CODE_ADDRESS);
@@ -298,11 +1419,10 @@ int vm_run_command()
                 break;
 
         case JUMP_YES:
-                if(arg < MAX_PROGRAM_SIZE) {
+                if((vm_uword) arg < vm_program_size) {
                         data = vm_pop();
                         if(data) {
-                                vm_command_pointer = arg;
-                                return 1;
+                                return vm_jump(index, arg);
                         }
                 }
                 else {
@@ -311,11 +1431,10 @@ int vm_run_command()
                 break;
 
         case JUMP_NO:
-                if(arg < MAX_PROGRAM_SIZE) {
+                if((vm_uword) arg < vm_program_size) {
                         data = vm_pop();
                         if(!data) {
-                                vm_command_pointer = arg;
-                                return 1;
+                                return vm_jump(index, arg);
                         }
                 }
                 else {
@@ -324,38 +1443,259 @@ int vm_run_command()
                 break;
 
         case INPUT:
+                if(vm_input->nonblocking && !vm_input_ready()) {
+                        return VM_BLOCKED;
+                }
                 vm_push(vm_read());
                 break;
 
+        case INPUT_BLOCK:
+                /*     */
+                control = vm_peek(2);
+                vm_check_range(control[0], control[1]);
+                data = vm_read_block(vm_memory + control[0], control[1]);
+                if(data < control[1]) {
+                        /*   :    , 
+                               */
+                        control[0] += data;
+                        control[1] -= data;
+                        return VM_BLOCKED;
+                }
+                vm_drop(2);
+                break;
+
+        case PRINT_BLOCK:
+                control = vm_peek(2);
+                vm_check_range(control[0], control[1]);
+                vm_write_block(vm_memory + control[0], control[1]);
+                vm_drop(2);
+                break;
+
+        case PRINT_STACK:
+                if(arg < 0 || (vm_uword) arg > vm_stack_depth()) {
+                        vm_error(STACK_EMPTY);
+                }
+                if(arg > 0) {
+                        vm_write_block(vm_peek(arg), arg);
+                        vm_drop(arg);
+                }
+                break;
+
         case PRINT:
 		vm_write(vm_pop());
                 break;
 
+        case LOOP:
+                if((vm_uword) arg < vm_program_size) {
+                        /* ,     */
+                        control = vm_peek(3);
+                        data = vm_load(control[2]);
+                        /*   :   ,
+                             ,    */
+                        sum = (vm_word) ((vm_uword) data + (vm_uword) control[1]);
+                        vm_store(control[2], sum);
+                        if(control[1] > 0 ? sum > data && sum <= control[0]
+                                          : sum < data && sum >= control[0]) {
+                                return vm_jump(index, arg);
+                        }
+                        vm_drop(3);
+                }
+                else {
+                        vm_error(BAD_CODE_ADDRESS);
+                }
+                break;
+
+        case CALL:
+                if((vm_uword) arg < vm_program_size) {
+                        if(vm_call_pointer >= vm_call_size
+                                        && !vm_grow_segment(CALL_SEGMENT, vm_call_pointer)) {
+                                vm_error(CALL_OVERFLOW);
+                        }
+                        vm_call_stack[vm_call_pointer++] = index + 1;
+                        /*   -   */
+                        return vm_jump(index, arg);
+                }
+                else {
+                        vm_error(BAD_CODE_ADDRESS);
+                }
+                break;
+
+        case JUMP_TABLE:
+                /*        */
+                if(arg >= 0 && (vm_uword) arg < vm_program_size - index) {
+                        data = vm_pop();
+                        if(data >= 0 && data < arg) {
+                                data = vm_program[index + 1 + data].arg;
+                                if((vm_uword) data < vm_program_size) {
+                                        return vm_jump(index, data);
+                                }
+                                vm_error(BAD_CODE_ADDRESS);
+                        }
+                        vm_command_pointer = index + 1 + arg;
+                        return VM_RUNNING;
+                }
+                vm_error(BAD_CODE_ADDRESS);
+                break;
+
+        case PARALLEL:
+                return vm_parallel(index, arg);
+
+        case RET:
+                if(vm_call_pointer > 0) {
+                        vm_command_pointer = vm_call_stack[--vm_call_pointer];
+                        return VM_RUNNING;
+                }
+                vm_error(RET_WITHOUT_CALL);
+                break;
+
         default:
 		vm_error(UNKNOWN_COMMAND);
         }
 
         ++vm_command_pointer;
-        return 1;
+        return VM_RUNNING;
 }
 
 void run()
 {
+        vm_init_segments();
+#ifdef VM_GUARD_STACK
+        vm_guard_stack();
+#endif
+#ifdef VM_TRACE
+        trace_start();
+#endif
+
 	vm_command_pointer = 0;
-	while(vm_command_pointer < MAX_PROGRAM_SIZE) {
-		if(!vm_run_command())
-			break;
-	}
+        if(IO_ASYNC == vm_io_mode) {
+                vm_async_start();
+        }
+
+        if(profile_enabled()) {
+                profile_run();
+        }
+        else {
+                while(vm_command_pointer < vm_program_size) {
+                        if(!vm_run_command())
+                                break;
+                }
+        }
+
+        vm_flush_output();
+        profile_report();
+#ifdef VM_TRACE
+        trace_dump(TRACE_EXIT, 0);
+#endif
+}
+
+void vm_new_context()
+{
+        int type;
+
+        for(type = PROGRAM_SEGMENT; type <= CALL_SEGMENT; ++type) {
+                vm_segments[type].base = NULL;
+                vm_segments[type].size = 0;
+                vm_segments[type].committed = 0;
+        }
+        vm_update_segment_pointers();
+
+        vm_command_pointer = 0;
+        vm_stack_pointer = 0;
+        vm_call_pointer = 0;
+#ifdef VM_GUARD_STACK
+        vm_stack_top = vm_stack;
+#endif
+        vm_input = &vm_stdin;
+        vm_output = &vm_stdout;
+}
+
+void vm_save_context(vm_context *context)
+{
+        memcpy(context->segments, vm_segments, sizeof(context->segments));
+        context->command_pointer = vm_command_pointer;
+#ifdef VM_GUARD_STACK
+        context->stack_pointer = vm_stack_top - vm_stack;
+#else
+        context->stack_pointer = vm_stack_pointer;
+#endif
+        context->call_pointer = vm_call_pointer;
+        context->input = vm_input;
+        context->output = vm_output;
+}
+
+void vm_load_context(const vm_context *context)
+{
+        memcpy(vm_segments, context->segments, sizeof(context->segments));
+        vm_update_segment_pointers();
+
+        vm_command_pointer = context->command_pointer;
+        vm_stack_pointer = context->stack_pointer;
+        vm_call_pointer = context->call_pointer;
+#ifdef VM_GUARD_STACK
+        vm_stack_top = vm_stack + context->stack_pointer;
+#endif
+        vm_input = context->input;
+        vm_output = context->output;
+}
+
+void vm_free_context(vm_context *context)
+{
+        int type;
+        segment *s;
+
+        for(type = PROGRAM_SEGMENT; type <= CALL_SEGMENT; ++type) {
+                s = &context->segments[type];
+                if(s->base) {
+                        munmap(s->base - vm_page_size,
+                                (size_t) MAX_SEGMENT_SIZE * s->element_size + 2 * vm_page_size);
+                        s->base = NULL;
+                        s->size = 0;
+                        s->committed = 0;
+                }
+        }
+}
+
+vm_status vm_run_slice(long long budget, const char *name)
+{
+        sigjmp_buf failure;
+        int status = VM_RUNNING;
+
+        if(sigsetjmp(failure, 1)) {
+                vm_error_jump = NULL;
+                vm_task_name = NULL;
+                vm_budget = VM_NO_BUDGET;
+                return VM_FAILED;
+        }
+
+        vm_error_jump = &failure;
+        vm_task_name = name;
+        vm_budget = budget;
+
+        while(VM_RUNNING == status) {
+                status = (vm_command_pointer < vm_program_size)
+                        ? vm_run_command() : VM_STOPPED;
+        }
+
+        vm_error_jump = NULL;
+        vm_task_name = NULL;
+        vm_budget = VM_NO_BUDGET;
+
+        if(VM_STOPPED == status || VM_BLOCKED == status) {
+                vm_write_buffer();
+        }
+
+        return status;
 }
 
 opcode_info* operation_info(operation op)
 {
-        return (op < opcodes_table_size) ? &opcodes_table[op] : NULL;
+        return ((unsigned int) op < (unsigned int) opcodes_table_size)
+                ? &opcodes_table[op] : NULL;
 }
 
-void put_command(unsigned int address, operation op, int arg)
+void put_command(unsigned int address, operation op, vm_word arg)
 {
-        if(address < MAX_PROGRAM_SIZE) {
+        if(vm_grow_segment(PROGRAM_SEGMENT, address)) {
                 vm_program[address].operation = op;
                 vm_program[address].arg = arg;
         }
@@ -364,8 +1704,18 @@ void put_command(unsigned int address, operation op, int arg)
         }
 }
 
-void set_mem(unsigned int address, int value)
+void set_mem(unsigned int address, vm_word value)
+{
+        if(vm_grow_segment(MEMORY_SEGMENT, address)) {
+                vm_memory[address] = value;
+        }
+        else {
+                milan_error("Illegal address in set_mem()");
+        }
+}
+
+void set_io_mode(io_mode mode)
 {
-        vm_memory[address] = value;
+        vm_io_mode = mode;
 }
 
@@ -2,17 +2,48 @@
 #define _MILAN_VM_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 /*  */
 
-/*    */
-#define MAX_PROGRAM_SIZE        65536
+/*   : 32 ( )  64 .
+ *   ,  -DVM_WORD_BITS=64. */
+#ifndef VM_WORD_BITS
+#define VM_WORD_BITS            32
+#endif
+
+#if VM_WORD_BITS == 64
+typedef int64_t vm_word;
+typedef uint64_t vm_uword;
+#define VM_WORD_MAX             INT64_MAX
+#define PRI_VM_WORD             PRId64
+#define SCN_VM_WORD             SCNd64
+#elif VM_WORD_BITS == 32
+typedef int32_t vm_word;
+typedef uint32_t vm_uword;
+#define VM_WORD_MAX             INT32_MAX
+#define PRI_VM_WORD             PRId32
+#define SCN_VM_WORD             SCNd32
+#else
+#error "VM_WORD_BITS must be 32 or 64"
+#endif
+
+/*      */
+#define DEFAULT_PROGRAM_SIZE    65536
+
+/*      */
+#define DEFAULT_MEMORY_SIZE     65536
+
+/*     */
+#define DEFAULT_STACK_SIZE      8192
 
-/*    */
-#define MAX_MEMORY_SIZE         65536
+/*      (   
+   ) */
+#define DEFAULT_CALL_SIZE       1024
 
-/*   */
-#define MAX_STACK_SIZE          8192
+/*    (   ) */
+#define MAX_SEGMENT_SIZE        (1 << 24)
 
 /*    */
 typedef enum {
@@ -35,7 +66,51 @@ typedef enum {
         JUMP_YES,       /*  ,      0 */
         JUMP_NO,        /*  ,     0 */
         INPUT,          /*       */
-        PRINT           /*       */
+        PRINT,          /*       */
+        LOOP,           /*    :    
+                         *   ,   -  .
+                         *    ,     
+                         *  ,  ,  ( 
+                         *    )   
+                         *    */
+        CALL,           /*  :   
+                         *     */
+        RET,            /*       */
+        JUMP_TABLE,     /*   :    arg
+                         *  JUMP.      v 
+                         *    0  arg - 1,  
+                         *    v-  ,  
+                         *    */
+        ADDI,           /*  arg      */
+        SUBI,           /*  arg      */
+        MULI,           /*       arg */
+        INC,            /*      1 */
+        DEC,            /*      1 */
+        ADDM,           /*       
+                         *   */
+        VADD,           /*      
+                         * (vector.h).    , 
+                         *   . VADD:  ,
+                         *  ,  */
+        VMUL,           /*      */
+        VSUM,           /*    ;   
+                         *    */
+        VFILL,          /* , ,    */
+        VCOPY,          /*  ,  ,  */
+        PARALLEL,       /*   (parallel.h): arg - 
+                         *   .   
+                         *  REDUCE, JUMP      ,
+                         *    - LOOP.  
+                         *    , 
+                         *   */
+        REDUCE,         /*   PARALLEL:    
+                         * arg  i-   
+                         *  (i-  -  -(i + 1)) */
+        INPUT_BLOCK,    /*      :  
+                         *     */
+        PRINT_BLOCK,    /*    :    */
+        PRINT_STACK     /*  arg       
+                         *   */
 } operation;
 
 /*   */
@@ -48,10 +123,71 @@ typedef enum {
         GE              /* >= */
 } compare_type;
 
+/*  - */
+typedef enum {
+        IO_INTERACTIVE, /*  "> "  ,   stderr */
+        IO_BATCH,       /*  ,    stdin
+                         *    stdout */
+        IO_ASYNC        /*  IO_BATCH,     
+                         *     */
+} io_mode;
+
+/*     */
+typedef enum {
+        PROGRAM_SEGMENT,        /*   */
+        MEMORY_SEGMENT,         /*   */
+        STACK_SEGMENT,          /*  */
+        CALL_SEGMENT            /*   CALL  RET:   
+                                 * ,    
+                                 *    */
+} segment_type;
+
+/* :    ,
+           */
+typedef struct {
+        char *base;             /*   */
+        size_t element_size;    /*     */
+        unsigned int size;      /*    */
+        size_t committed;       /*     */
+} segment;
+
+/*        */
+typedef struct {
+        int fd;                 /*   */
+        char *data;             /*  */
+        size_t capacity;        /*   */
+        size_t position;        /* :   */
+        size_t size;            /*    */
+        unsigned int line;      /* :    */
+        int nonblocking;        /* : INPUT   ,  
+                                 *  (. vm_run_slice) */
+        int eof;                /* :   */
+        char error[128];        /* :    BAD_INPUT */
+} io_stream;
+
+/*    */
+typedef struct {
+        segment segments[4];            /*    segment_type */
+        unsigned int command_pointer;   /*    */
+        unsigned int stack_pointer;     /*   */
+        unsigned int call_pointer;      /*    */
+        io_stream *input;               /*   INPUT */
+        io_stream *output;              /*   PRINT */
+} vm_context;
+
+/*      */
+typedef enum {
+        VM_STOPPED = 0, /*   */
+        VM_RUNNING,     /*   */
+        VM_YIELD,       /*   */
+        VM_BLOCKED,     /* INPUT  ,     */
+        VM_FAILED       /*    */
+} vm_status;
+
 /*     */
 typedef struct {
         operation operation; /*   */
-        int arg;         /*  */
+        vm_word arg;         /*  */
 } command;
 
 /*    */
@@ -67,9 +203,26 @@ typedef struct opcode_info {
 
 opcode_info* operation_info(operation op);
 
-/*        address. */
+/*    (   ).
+ *
+ *       
+ *  MAX_SEGMENT_SIZE ,    
+ *    ,    
+ *    .    
+ *  ,     .
+ *  0  .
+ */
+
+int set_segment_size(segment_type segment, unsigned int size);
 
-void put_command(unsigned int address, operation op, int arg);
+/*    */
+
+unsigned int get_segment_size(segment_type segment);
+
+/*        address.
+ *     . */
+
+void put_command(unsigned int address, operation op, vm_word arg);
 
 /*  .
  *
@@ -80,9 +233,57 @@ void put_command(unsigned int address, operation op, int arg);
 
 void run();
 
-/*   value      address. */
+/*   value      address.
+ *     . */
+
+void set_mem(unsigned int address, vm_word value);
+
+/*   -   INPUT  PRINT.
+ *
+ *    stdin      scanf,
+ *   PRINT       stdout
+ *   ,      
+ *  .         
+ *  ,        
+ *  .
+ */
+
+void set_io_mode(io_mode mode);
+
+/*  .
+ *
+ *   (,    ,
+ *  -)    .  
+ *   ,   (sched.h) 
+ * ,    .
+ */
+
+/*  :     ,
+ * INPUT  PRINT   stdin  stdout */
+
+void vm_new_context();
+
+void vm_save_context(vm_context *context);
+
+void vm_load_context(const vm_context *context);
+
+/*     */
+
+void vm_free_context(vm_context *context);
+
+/*   ,    .
+ *
+ *     :     
+ *    budget,     
+ * VM_YIELD.     ,  
+ *     .     
+ *     , INPUT  VM_BLOCKED. 
+ *     stderr   name 
+ *     (VM_FAILED).  
+ *       .
+ */
 
-void set_mem(unsigned int address, int value);
+vm_status vm_run_slice(long long budget, const char *name);
 
 #endif
 
@@ -1,23 +1,22 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
-/* A Bison parser, made by GNU Bison 2.4.1.  */
+/* Bison interface for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
 
-/* Skeleton interface for Bison's Yacc-like parsers in C
-   
-      Copyright (C) 1984, 1989, 1990, 2000, 2001, 2002, 2003, 2004, 2005, 2006
-   Free Software Foundation, Inc.
-   
    This program is free software: you can redistribute it and/or modify
    it under the terms of the GNU General Public License as published by
    the Free Software Foundation, either version 3 of the License, or
    (at your option) any later version.
-   
+
    This program is distributed in the hope that it will be useful,
    but WITHOUT ANY WARRANTY; without even the implied warranty of
    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
    GNU General Public License for more details.
-   
+
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* As a special exception, you may create a larger work that contains
    part or all of the Bison parser skeleton and distribute that work
@@ -28,52 +27,85 @@
    special exception, which will cause the skeleton and the resulting
    Bison output files to be licensed under the GNU General Public
    License without this special exception.
-   
+
    This special exception was added by the Free Software Foundation in
    version 2.2 of Bison.  */
 
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
 
-/* Tokens.  */
-#ifndef YYTOKENTYPE
-# define YYTOKENTYPE
-   /* Put the tokens into the symbol table, so that GDB and other debuggers
-      know about them.  */
-   enum yytokentype {
-     T_INT = 258,
-     T_SET = 259,
-     T_NOP = 260,
-     T_STOP = 261,
-     T_LOAD = 262,
-     T_STORE = 263,
-     T_BLOAD = 264,
-     T_BSTORE = 265,
-     T_PUSH = 266,
-     T_POP = 267,
-     T_DUP = 268,
-     T_INVERT = 269,
-     T_ADD = 270,
-     T_SUB = 271,
-     T_MULT = 272,
-     T_DIV = 273,
-     T_COMPARE = 274,
-     T_JUMP = 275,
-     T_JUMP_YES = 276,
-     T_JUMP_NO = 277,
-     T_INPUT = 278,
-     T_PRINT = 279,
-     T_COLON = 280
-   };
+#ifndef YY_YY_VMPARSE_TAB_H_INCLUDED
+# define YY_YY_VMPARSE_TAB_H_INCLUDED
+/* Debug traces.  */
+#ifndef YYDEBUG
+# define YYDEBUG 0
 #endif
+#if YYDEBUG
+extern int yydebug;
+#endif
+/* "%code requires" blocks.  */
+#line 1 "vmparse.y"
+
+#include "vm.h"
 
+#line 53 "vmparse.tab.h"
 
+/* Token kinds.  */
+#ifndef YYTOKENTYPE
+# define YYTOKENTYPE
+  enum yytokentype
+  {
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    T_INT = 258,                   /* T_INT  */
+    T_SET = 259,                   /* T_SET  */
+    T_NOP = 260,                   /* T_NOP  */
+    T_STOP = 261,                  /* T_STOP  */
+    T_LOAD = 262,                  /* T_LOAD  */
+    T_STORE = 263,                 /* T_STORE  */
+    T_BLOAD = 264,                 /* T_BLOAD  */
+    T_BSTORE = 265,                /* T_BSTORE  */
+    T_PUSH = 266,                  /* T_PUSH  */
+    T_POP = 267,                   /* T_POP  */
+    T_DUP = 268,                   /* T_DUP  */
+    T_INVERT = 269,                /* T_INVERT  */
+    T_ADD = 270,                   /* T_ADD  */
+    T_SUB = 271,                   /* T_SUB  */
+    T_MULT = 272,                  /* T_MULT  */
+    T_DIV = 273,                   /* T_DIV  */
+    T_COMPARE = 274,               /* T_COMPARE  */
+    T_JUMP = 275,                  /* T_JUMP  */
+    T_JUMP_YES = 276,              /* T_JUMP_YES  */
+    T_JUMP_NO = 277,               /* T_JUMP_NO  */
+    T_INPUT = 278,                 /* T_INPUT  */
+    T_PRINT = 279,                 /* T_PRINT  */
+    T_COLON = 280                  /* T_COLON  */
+  };
+  typedef enum yytokentype yytoken_kind_t;
+#endif
 
+/* Value type.  */
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
-typedef int YYSTYPE;
+typedef vm_word YYSTYPE;
 # define YYSTYPE_IS_TRIVIAL 1
-# define yystype YYSTYPE /* obsolescent; will be withdrawn */
 # define YYSTYPE_IS_DECLARED 1
 #endif
 
+
 extern YYSTYPE yylval;
 
 
+int yyparse (void);
+
+/* "%code provides" blocks.  */
+#line 5 "vmparse.y"
+
+/*   -?[0-9]+      */
+int legacy_number(const char *text, vm_word *value);
+
+#line 110 "vmparse.tab.h"
+
+#endif /* !YY_YY_VMPARSE_TAB_H_INCLUDED  */
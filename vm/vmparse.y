@@ -1,14 +1,24 @@
-%{
+%code requires {
 #include "vm.h"
+}
+
+%code provides {
+/*   -?[0-9]+      */
+int legacy_number(const char *text, vm_word *value);
+}
+
+%{
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#define YYSTYPE int
-
 int yylex();
 void yyerror(char const *);
 %}
 
+/*  -  :  mvm64  64- */
+%define api.value.type {vm_word}
+
 %token T_INT
 %token T_SET
 %token T_NOP
@@ -35,7 +45,7 @@ void yyerror(char const *);
 
 %%
 
-program         : line program
+program         : program line
                 | line
                 ;
 
@@ -68,3 +78,18 @@ void yyerror(char const *str)
         printf("Error: %s\n", str);
 }
 
+int legacy_number(const char *text, vm_word *value)
+{
+        long long number;
+
+        errno = 0;
+        number = strtoll(text, NULL, 10);
+        if(ERANGE == errno || number > VM_WORD_MAX || number < -VM_WORD_MAX - 1) {
+                yyerror("number is out of range");
+                return 0;
+        }
+
+        *value = (vm_word) number;
+        return 1;
+}
+